@@ -68,6 +68,16 @@ public:
         std::cout<< "mean: " << mean_[i] << ", sigma: " << sigma_[i] << std::endl;
     }
     
+    /// Returns means
+    CUDA_HOST_DEVICE
+    const std::array<T,M>&
+    mean() const { return mean_; }
+
+    /// Returns sigmas
+    CUDA_HOST_DEVICE
+    const std::array<T,M>&
+    sigma() const { return sigma_; }
+
     /// Destructor
     CUDA_HOST_DEVICE
     ~pdf_Md(){;}
@@ -77,7 +87,7 @@ public:
     CUDA_HOST_DEVICE
     virtual 
     std::array<T,M>
-    operator()(std::default_random_engine* rng) = 0;
+    operator()(mqi::philox_rng* rng) = 0;
 
 };
 
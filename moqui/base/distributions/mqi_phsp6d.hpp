@@ -22,10 +22,6 @@ class phsp_6d : public pdf_Md<T, 6>
     std::array<T, 2> rho_;   ///< For X,Y
 
 public:
-    /// Random engine and distribution function
-    //    std::default_random_engine  gen_;
-    std::normal_distribution<T> func_;
-
     /// Constructor to initializes mean, sigma, rho, and random engine
     /// \param m[0,1,2]: mean spot-position  of x, y, z
     /// \param m[3,4,5]: mean spot-direction of x', y', z'.
@@ -41,7 +37,6 @@ public:
         //#if !defined(__CUDACC__)
         //        gen_.seed(std::chrono::system_clock::now().time_since_epoch().count());
         //        gen_.seed(1000);
-        func_ = std::normal_distribution<T>(0, 1);
         //#endif
     }
 
@@ -52,20 +47,19 @@ public:
         //#if !defined(__CUDACC__)
         //        gen_.seed(std::chrono::system_clock::now().time_since_epoch().count());
         //        gen_.seed(1000);
-        func_ = std::normal_distribution<T>(0, 1);
         //#endif
     }
 
     /// Sample 6 phase-space variables and returns
     CUDA_HOST_DEVICE
     virtual std::array<T, 6>
-    operator()(std::default_random_engine* rng) {
+    operator()(mqi::philox_rng* rng) {
         std::array<T, 6> phsp = pdf_Md<T, 6>::mean_;
-        T                Ux   = func_(*rng);
-        T                Vx   = func_(*rng);
-        T                Uy   = func_(*rng);
-        T                Vy   = func_(*rng);
-        T                Uz   = func_(*rng);   //T Vz = func_(rng);
+        T                Ux   = static_cast<T>(rng->normal());
+        T                Vx   = static_cast<T>(rng->normal());
+        T                Uy   = static_cast<T>(rng->normal());
+        T                Vy   = static_cast<T>(rng->normal());
+        T                Uz   = static_cast<T>(rng->normal());   //T Vz = func_(rng);
         phsp[0] += pdf_Md<T, 6>::sigma_[0] * Ux;
         phsp[1] += pdf_Md<T, 6>::sigma_[1] * Uy;
         phsp[2] += pdf_Md<T, 6>::sigma_[2] * Uz;
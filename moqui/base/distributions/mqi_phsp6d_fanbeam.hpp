@@ -27,7 +27,6 @@ public:
     
     /// Random engine and distribution function
 //    std::default_random_engine        gen_ ;
-    std::normal_distribution<T>       func_;
 
     /// uniform distributions to place x and y position
     /// positions are determined with SAD
@@ -49,7 +48,6 @@ public:
 //        gen_.seed(std::chrono::system_clock::now().time_since_epoch().count());
         unifx_ = std::uniform_real_distribution<T>(m[0], m[1]); 
         unify_ = std::uniform_real_distribution<T>(m[2], m[3]); 
-        func_ = std::normal_distribution<T>(0, 1); 
         //#endif
     }
     
@@ -68,7 +66,6 @@ public:
 //        gen_.seed(std::chrono::system_clock::now().time_since_epoch().count());
         unifx_ = std::uniform_real_distribution<T>(m[0], m[1]); 
         unify_ = std::uniform_real_distribution<T>(m[2], m[3]); 
-        func_ = std::normal_distribution<T>(0, 1); 
         //#endif
     }
 
@@ -77,7 +74,7 @@ public:
     CUDA_HOST_DEVICE
     virtual 
     std::array<T,6>
-    operator()(std::default_random_engine* rng)
+    operator()(mqi::philox_rng* rng)
     {
 	    auto x = unifx_(*rng) ;
 	    auto y = unify_(*rng) ;
@@ -85,8 +82,8 @@ public:
 	    mqi::vec3<T> dir(std::atan(x/SAD_[0]), std::atan(y/SAD_[1]), -1.0);
 
         std::array<T,6> phsp ; 
-        T Ux = func_(*rng); T Vx = func_(*rng);
-        T Uy = func_(*rng); T Vy = func_(*rng);
+        T Ux = static_cast<T>(rng->normal()); T Vx = static_cast<T>(rng->normal());
+        T Uy = static_cast<T>(rng->normal()); T Vy = static_cast<T>(rng->normal());
 
         phsp[0] = x + pdf_Md<T,6>::sigma_[0]* Ux ; 
         phsp[1] = y + pdf_Md<T,6>::sigma_[1]* Uy ; 
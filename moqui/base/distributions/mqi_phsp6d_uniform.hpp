@@ -65,7 +65,7 @@ public:
     /// Sample 6 phase-space variables and returns
     CUDA_HOST_DEVICE
     virtual std::array<T, 6>
-    operator()(std::default_random_engine* rng) {
+    operator()(mqi::philox_rng* rng) {
         std::array<T, 6> phsp = pdf_Md<T, 6>::mean_;
         T                Ux   = func_(*rng);
         T                Vx   = func_(*rng);
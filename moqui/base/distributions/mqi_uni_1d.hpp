@@ -50,7 +50,7 @@ public:
     CUDA_HOST_DEVICE
     virtual 
     std::array<T,1>
-    operator()(std::default_random_engine* rng){
+    operator()(mqi::philox_rng* rng){
         return {func_(*rng)};
     };
 
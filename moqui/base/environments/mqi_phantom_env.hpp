@@ -285,9 +285,8 @@ public:
         std::ifstream              ph_fid(this->phantom_path, std::ios::in | std::ios::binary);
         ph_fid.read((char*) (&ph[0]), nxyz.x * nxyz.y * nxyz.z * sizeof(ph[0]));
         ph_fid.close();
-        for (int i = 0; i < nxyz.x * nxyz.y * nxyz.z; i++) {
-            rho_mass[i] = patient_material.hu_to_density(ph[i]);
-        }
+        patient_material.hu_to_density(
+          ph, rho_mass, size_t(nxyz.x) * nxyz.y * nxyz.z, mqi::host_threads(0));
         phantom->geo->set_data(rho_mass);   //// Material conversion function required
 
         ///< TODO : compile error (type of dE)
@@ -18,20 +18,31 @@
 #include "gdcmStringFilter.h"
 #include "gdcmTag.h"
 #include "gdcmTesting.h"
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <set>
 #include <moqui/base/materials/mqi_patient_materials.hpp>
 #include <moqui/base/mqi_aperture.hpp>
 #include <moqui/base/mqi_aperture3d.hpp>
+#include <moqui/base/mqi_batch_pipeline.hpp>
+#include <moqui/base/mqi_contour_raster.hpp>
+#include <moqui/base/mqi_ct_cache.hpp>
+#include <moqui/base/mqi_dicom_index.hpp>
+#include <moqui/base/mqi_ct_clip.hpp>
 #include <moqui/base/mqi_distributions.hpp>
+#include <moqui/base/mqi_empty_space.hpp>
 #include <moqui/base/mqi_file_handler.hpp>
 #include <moqui/base/mqi_io.hpp>
+#include <moqui/base/mqi_log_reader.hpp>
 #include <moqui/base/mqi_math.hpp>
+#include <moqui/base/mqi_parallel.hpp>
 #include <moqui/base/mqi_rangeshifter.hpp>
 #include <moqui/base/mqi_roi.hpp>
 #include <moqui/base/mqi_threads.hpp>
@@ -122,16 +133,40 @@ public:
     bool                       overwrite_results = false;
     bool                       use_absolute_path;
     size_t                     max_histories_per_batch;
+    uint32_t                   histories_per_chunk = 256;   ///< work unit of host worker threads
+    uint32_t                   batch_buffers       = 2;     ///< batches in flight when batched
+    std::atomic<uint32_t>      producer_workers{ 0 };       ///< workers lent to the batch producer
+    bool                       on_the_fly_source   = false;   ///< sample primaries in the workers (CPU)
+    uint32_t                   host_workers        = 1;     ///< host threads for pre-processing
+    bool                       concurrent_startup  = true;  ///< overlap CT, RT plan and log loading
+    bool                       private_scoring     = false;   ///< thread-private dose tiles (CPU)
+    size_t                     private_scoring_mb  = 1024;    ///< memory budget of the private tiles
+    bool                       dense_scorer        = true;    ///< per-ROI-voxel arrays instead of hash tables
+    bool                       woodcock_tracking   = false;   ///< delta tracking in the patient node
+    bool                       empty_space_skip    = false;   ///< cross air in one step
+    float                      air_threshold       = 0.05;    ///< g/cm3, empty space is below
+    float                      density_bin_width   = 1e-4;    ///< g/cm3, 0 disables the density table
     bool                       memory_save_mode;
     bool                       save_scorer_map;
     std::string                scorer_map_prefix;
     dicom_t                    dcm_;
     logfiles_t                 log_file;
-    int16_t*                   ct_data;
+    density_t*                 ct_density = nullptr;   ///< densities of the CT grid, shared by all beams
+    bool                       ct_cache   = true;      ///< cache of the CT grid in the DICOM directory
+    bool                       dicom_index_cache = true;   ///< cache of the DICOM header index
+    std::vector<mqi::file_key_t>      dicom_files;     ///< fingerprint of dicom_dir for the CT cache
+    std::unique_ptr<mqi::mapped_file> ct_cache_map;    ///< keeps ct_density and the body mask of a read cache
     mqi::treatment_session<R>* tx;
     uint16_t                   bnb                   = 0;
     float                      sid                   = 0.0;
     float                      particles_per_history = -1.0;
+    float                      log_spot_tolerance    = 0.0;   ///< mm, merge log samples closer than this
+    bool                       log_cache             = true;  ///< binary cache of parsed log files
+    bool                       log_prefetch          = false; ///< read the next beam's logs during transport
+    std::vector<mqi::log_field_files_t> log_index;   ///< field folders of logfile_dir, by beam index
+    std::future<mqi::log_field_t>       log_prefetched;
+    int                                 log_prefetched_index = -1;
+    std::future<std::unique_ptr<mqi::treatment_session<R>>> plan_loading;   ///< RT plan parsed during read_dcm_dir
     std::string                beam_prefix;
     density_t*                 stopping_power;
     float                      max_let_in_water;
@@ -139,6 +174,9 @@ public:
     mqi::aperture_type_t       aperture_type = mqi::VOLUME;
     std::vector<float>         scorer_voxel_size;
     bool                       ct_clipping;
+    float                      ct_clipping_margin = 10.0;   ///< mm around the body kept by clipping
+    mqi::clip_box_t            ct_clip;                     ///< patient grid inside the CT grid
+    node_t<R>*                 ct_phantom = nullptr;        ///< CT phantom node of the current beam
     int                        verbosity;
     std::string                body_contour_name;
     bool                       read_structure;
@@ -175,6 +213,17 @@ public:
         this->num_total_threads = parser.get_int("TotalThreads", -1);
         beam_prefix             = parser.get_string("BeamPrefix", "beam");
         max_histories_per_batch = parser.get_int("MaxHistoriesPerBatch", 0);
+        int chunk_size          = parser.get_int("HistoriesPerChunk", 256);
+        histories_per_chunk     = (chunk_size > 0) ? chunk_size : 256;
+        int n_batch_buffers     = parser.get_int("BatchBuffers", 2);
+        batch_buffers           = (n_batch_buffers > 0) ? n_batch_buffers : 1;
+        on_the_fly_source       = parser.get_bool("OnTheFlySource", false);
+#if defined(__CUDACC__)
+        host_workers = mqi::host_threads(0);   ///< TotalThreads is the number of GPU threads
+#else
+        host_workers = mqi::host_threads(this->num_total_threads);
+#endif
+        concurrent_startup      = parser.get_bool("ConcurrentStartup", true);
         //        std::string aperture_string = parser.get_string("ApertureType", "VOLUME");
         //        aperture_type           = parser.string_to_aperture_type(aperture_string);
 
@@ -226,6 +275,13 @@ public:
         source_type = parser.get_string("SourceType", "FluenceMap");
         sim_type    = parser.string_to_sim_type(parser.get_string("SimulationType", "perBeam"));
         particles_per_history = parser.get_float("ParticlesPerHistory", -1.0);
+        log_spot_tolerance    = parser.get_float("LogSpotTolerance", 0.0);
+        log_cache             = parser.get_bool("LogCache", true);
+        log_prefetch          = parser.get_bool("LogPrefetch", false);
+
+        // Field folders and their layer files are listed once for all beams
+        this->log_index = mqi::index_log_dir(logfile_dir);
+        printf("Indexing log file directory.. : %lu field folders\n", this->log_index.size());
 
         // -------------------------------------------------------------------------------------------
         /// Scorer parameters
@@ -237,14 +293,25 @@ public:
         //// Set simulation type to per spot for dose dij matrix scoring
         if (this->scorer_type == mqi::DOSE_Dij) { this->sim_type = mqi::PER_SPOT; }
         score_variance          = !parser.get_bool("SupressStd", true);
+        private_scoring         = parser.get_bool("PrivateScoring", false);
+        int private_mb          = parser.get_int("PrivateScoringMemory", 1024);
+        private_scoring_mb      = (private_mb > 0) ? private_mb : 0;
+        dense_scorer            = parser.get_bool("DenseScorer", true);
+        woodcock_tracking       = parser.get_bool("WoodcockTracking", false);
+        empty_space_skip        = parser.get_bool("EmptySpaceSkipping", false);
+        air_threshold           = parser.get_float("AirDensityThreshold", 0.05);
+        density_bin_width       = parser.get_float("DensityTableBinWidth", 1e-4);
         score_to_ct_grid        = parser.get_bool("ScoreToCTGrid", true);
         scoring_mask            = parser.get_bool("ScoringMask", false);
-        ct_clipping             = false;   //parser.get_bool("CTClipping", false);
+        ct_clipping             = parser.get_bool("CTClipping", false);
+        ct_clipping_margin      = parser.get_float("CTClippingMargin", 10.0);
         this->body_contour_name = parser.get_string("BodyContourName", "External");
         this->read_structure    = parser.get_bool("ReadStructure", false);
 
         // If user use phantom geometry, override reading structure false
         if (this->usingPhantomGeo) this->read_structure = false; 
+        this->ct_cache          = parser.get_bool("CTCache", true);
+        this->dicom_index_cache = parser.get_bool("DicomIndexCache", true);
 
         if (scoring_mask) {
             save_scorer_map = parser.get_bool("SaveMap", true);
@@ -310,8 +377,24 @@ public:
         std::string machineName = "";
         std::string referenceMCName = "";
 
-        // Creating treatment machine object from plan information
-        tx = new mqi::treatment_session<R>(dcm_.plan_name, machineName, referenceMCName, this->selectedGantryNumber);
+        // Creating treatment machine object from plan information, unless read_dcm_dir started it
+        if (this->plan_loading.valid()) {
+            tx = this->plan_loading.get().release();
+        } else {
+            tx = new mqi::treatment_session<R>(dcm_.plan_name, machineName, referenceMCName, this->selectedGantryNumber);
+        }
+
+        // CT values are converted to densities once for all beams, unless they came from the cache.
+        // The densities are the only copy of the CT kept: the HU volume is released afterwards.
+        if (!this->usingPhantomGeo && this->ct_density == nullptr) {
+            size_t n_voxels  = size_t(dcm_.dim_.x) * dcm_.dim_.y * dcm_.dim_.z;
+            this->ct_density = new density_t[n_voxels];
+            std::cout << "Creating material information for grid.." << std::endl;
+            this->tx->material_.hu_to_density(
+              &this->dcm_.ct->get_data()[0], this->ct_density, n_voxels, this->host_workers);
+            this->dcm_.ct->release_data();
+            if (this->ct_cache) this->write_ct_cache();
+        }
         if (sim_type == mqi::PER_BEAM) {
             beam_numbers = parser.get_int_vector("BeamNumbers", ",");
             if (beam_numbers.size() == 0) {
@@ -348,6 +431,24 @@ public:
                 beam_numbers.push_back(k);
             }
         }
+
+        ///< The variance tables are indexed by voxel of the transport grid and are not mapped back
+        if (this->ct_clipping && this->score_variance) {
+            printf("Clipping CT.. : CT clipping disabled, variance is scored on the CT grid\n");
+            this->ct_clipping = false;
+        }
+        if (this->ct_clipping && !this->usingPhantomGeo) {
+            this->clip_ct();
+            if (this->scorer_type == mqi::DOSE || this->scorer_type == mqi::LETd ||
+                this->scorer_type == mqi::LETt) {
+                this->scorer_capacity = this->dcm_.dim_.x * this->dcm_.dim_.y * this->dcm_.dim_.z;
+            }
+        }
+
+        // Logs of the first beam are read while the world is set up
+        if (this->concurrent_startup && !beam_numbers.empty()) {
+            this->prefetch_logfile_dir(beam_numbers[0] - 1);
+        }
     }
 
     CUDA_HOST
@@ -366,15 +467,33 @@ public:
         printf("Random seed %d\n", master_seed);
         printf("The number of total threads %d\n", this->num_total_threads);
         printf("Maximum histories per batch %lu\n", max_histories_per_batch);
+        printf("Histories per chunk (CPU) %u\n", histories_per_chunk);
+        printf("Batch buffers %u\n", batch_buffers);
+        printf("On-the-fly source sampling (CPU) %d\n", on_the_fly_source);
+        printf("Host threads for pre-processing %u\n", host_workers);
+        printf("Concurrent startup %d\n", concurrent_startup);
         printf("================================\n");
         printf("Setup parameters\n");
         printf("================================\n");
         printf("Patient directory %s\n", parent_dir.c_str());
         printf("DICOM directory %s\n", dicom_dir.c_str());
         printf("Log file directory %s\n", logfile_dir.c_str());
+        printf("CT cache %d\n", ct_cache);
+        printf("DICOM index cache %d\n", dicom_index_cache);
+        printf("CT clipping %d, margin %f mm\n", ct_clipping, ct_clipping_margin);
         printf("Scorer type %d\n", this->scorer_type);
         printf("Supress variance %d\n", !score_variance);
+        printf("Private scoring (CPU) %d, memory budget %lu MB\n", private_scoring, private_scoring_mb);
+        printf("Dense scorer %d\n", dense_scorer);
+        printf("Woodcock tracking %d\n", woodcock_tracking);
+        printf("Empty space skipping %d, air density threshold %f g/cm3\n",
+               empty_space_skip,
+               air_threshold);
+        printf("Density table bin width %f g/cm3\n", density_bin_width);
         printf("Particles per histories %.1f\n", particles_per_history);
+        printf("Log spot tolerance %f mm\n", log_spot_tolerance);
+        printf("Log file cache %d\n", log_cache);
+        printf("Log file prefetch %d\n", log_prefetch);
         printf("Source type %s\n", source_type.c_str());
         printf("Simulation type %d\n", sim_type);
         if (sim_type == mqi::PER_BEAM) {
@@ -406,30 +525,182 @@ public:
         }
     }
 
+    ///< Crop the patient grid to the body plus ct_clipping_margin. The body is the body contour
+    ///< when the structure is read, otherwise the voxels denser than air_threshold.
+    CUDA_HOST
+    void
+    clip_ct() {
+        const mqi::vec3<ijk_t> dim = this->dcm_.org_dim_;
+        const float            m   = this->ct_clipping_margin;
+        const float            dz  = (this->dcm_.org_ze[dim.z] - this->dcm_.org_ze[0]) / dim.z;
+        mqi::vec3<ijk_t>       margin(std::ceil(m / this->dcm_.dx), std::ceil(m / this->dcm_.dy), std::ceil(m / dz));
+        const uint8_t*         body      = this->read_structure ? this->dcm_.body_contour : nullptr;
+        const density_t*       density   = this->ct_density;
+        const density_t        threshold = this->air_threshold / 1000.0;
+        if (body) {
+            this->ct_clip = mqi::bounding_box(dim, margin, [body](size_t v) { return body[v] > 0; });
+        } else {
+            this->ct_clip =
+              mqi::bounding_box(dim, margin, [density, threshold](size_t v) { return density[v] > threshold; });
+        }
+        if (this->ct_clip.is_full()) {
+            std::cout << "Clipping CT.. : Body fills the CT grid, not clipped" << std::endl;
+            return;
+        }
+
+        ///< arrays from the CT cache stay in its mapping
+        bool owned = (this->ct_cache_map == nullptr);
+        density_t* cropped = mqi::crop(this->ct_density, this->ct_clip);
+        if (owned) delete[] this->ct_density;
+        this->ct_density = cropped;
+        if (body) {
+            uint8_t* cropped_body = mqi::crop(body, this->ct_clip);
+            if (owned) delete[] this->dcm_.body_contour;
+            this->dcm_.body_contour = cropped_body;
+        }
+        this->dcm_.dim_        = this->ct_clip.dim;
+        this->dcm_.xe          = this->dcm_.org_xe + this->ct_clip.shift.x;
+        this->dcm_.ye          = this->dcm_.org_ye + this->ct_clip.shift.y;
+        this->dcm_.ze          = this->dcm_.org_ze + this->ct_clip.shift.z;
+        this->dcm_.dz          = this->dcm_.org_dz + this->ct_clip.shift.z;
+        this->dcm_.clip_shift_ = mqi::vec3<uint16_t>(this->ct_clip.shift.x, this->ct_clip.shift.y, this->ct_clip.shift.z);
+        std::cout << "Clipping CT.. : (nx, ny, nz) -> (" << dim.x << ", " << dim.y << ", " << dim.z << ") --> ("
+                  << this->dcm_.dim_.x << ", " << this->dcm_.dim_.y << ", " << this->dcm_.dim_.z
+                  << "), first voxel (" << this->ct_clip.shift.x << ", " << this->ct_clip.shift.y << ", "
+                  << this->ct_clip.shift.z << ")" << std::endl;
+    }
+
+    ///< Map the scorers of a clipped CT phantom back to the CT grid before the results are saved
+    CUDA_HOST
+    void
+    unclip_outputs() {
+        if (this->ct_phantom == nullptr || this->ct_clip.is_full()) return;
+        for (int s_ind = 0; s_ind < this->ct_phantom->n_scorers; s_ind++) {
+            mqi::unclip_scorer(this->ct_phantom->scorers[s_ind], this->ct_clip);
+        }
+        ///< the output writers take the grid from the node, the clipped grid does not own its arrays
+        delete this->ct_phantom->geo;
+        this->ct_phantom->geo = new grid3d<density_t, R>(this->dcm_.org_xe,
+                                                        this->dcm_.org_dim_.x + 1,
+                                                        this->dcm_.org_ye,
+                                                        this->dcm_.org_dim_.y + 1,
+                                                        this->dcm_.org_ze,
+                                                        this->dcm_.org_dim_.z + 1);
+        this->ct_phantom = nullptr;
+    }
+
+    ///< Parse the RT plan into a treatment_session in the background, the constructor takes it.
+    ///< The future owns the session until then, so it is freed if the constructor throws first.
+    CUDA_HOST
+    void
+    start_plan_loading(const std::string& plan_name) {
+        if (!this->concurrent_startup) return;
+        int gantry         = this->selectedGantryNumber;
+        this->plan_loading = std::async(std::launch::async, [plan_name, gantry]() {
+            return std::unique_ptr<mqi::treatment_session<R>>(
+              new mqi::treatment_session<R>(plan_name, "", "", gantry));
+        });
+    }
+
+    ///< Fill dcm from the CT cache of dicom_dir, returns false if there is no valid cache
+    CUDA_HOST
+    bool
+    read_ct_cache(dicom_t& dcm) {
+        auto start        = std::chrono::high_resolution_clock::now();
+        this->dicom_files = mqi::dir_file_keys(dicom_dir);
+        std::filesystem::path cache = std::filesystem::path(dicom_dir) / mqi::ct_cache_name;
+        uint64_t   lut_hash = mqi::density_lut_hash(mqi::patient_material_t<R>().density_lut());
+        mqi::ct_cache_t cached;
+        if (!mqi::read_ct_cache(cache,
+                                this->dicom_files,
+                                lut_hash,
+                                this->read_structure ? this->body_contour_name : "",
+                                cached))
+            return false;
+        if (cached.plan_list.empty()) return false;
+
+        dcm.nfiles      = this->dicom_files.size();
+        dcm.plan_list   = cached.plan_list;
+        dcm.struct_list = cached.struct_list;
+        dcm.n_plan      = dcm.plan_list.size();
+        dcm.n_struct    = dcm.struct_list.size();
+        dcm.plan_name   = dcm.plan_list[0];
+        dcm.struct_name = (dcm.n_struct > 0) ? dcm.struct_list[0] : "";
+        this->start_plan_loading(dcm.plan_name);
+
+        dcm.ct       = nullptr;
+        dcm.dim_     = { cached.nx, cached.ny, cached.nz };
+        dcm.org_dim_ = dcm.dim_;
+        dcm.dx       = cached.dx;
+        dcm.dy       = cached.dy;
+        dcm.org_dz   = new float[cached.nz];
+        dcm.org_xe   = new float[cached.nx + 1];
+        dcm.org_ye   = new float[cached.ny + 1];
+        dcm.org_ze   = new float[cached.nz + 1];
+        std::copy(cached.dz.begin(), cached.dz.end(), dcm.org_dz);
+        std::copy(cached.xe.begin(), cached.xe.end(), dcm.org_xe);
+        std::copy(cached.ye.begin(), cached.ye.end(), dcm.org_ye);
+        std::copy(cached.ze.begin(), cached.ze.end(), dcm.org_ze);
+        dcm.image_center.x = (dcm.org_xe[0] + dcm.dx / 2.0 + dcm.org_xe[dcm.dim_.x] - dcm.dx / 2.0) / 2.0;
+        dcm.image_center.y = (dcm.org_ye[0] + dcm.dy / 2.0 + dcm.org_ye[dcm.dim_.y] - dcm.dy / 2.0) / 2.0;
+        dcm.image_center.z = (dcm.org_ze[0] + dcm.org_dz[0] / 2.0 + dcm.org_ze[dcm.dim_.z] - dcm.org_dz[dcm.dim_.z - 1] / 2.0) / 2.0;
+        dcm.xe = dcm.org_xe;
+        dcm.ye = dcm.org_ye;
+        dcm.ze = dcm.org_ze;
+        dcm.dz = dcm.org_dz;
+
+        this->ct_density   = cached.density;
+        dcm.body_contour   = cached.body_mask;
+        this->ct_cache_map = std::move(cached.map);
+
+        std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "Reading DICOM directory.. : CT grid of series " << cached.series_uid
+                  << " mapped from cache " << cache.string() << " in " << duration.count() << " ms" << std::endl;
+        return true;
+    }
+
+    ///< Write the CT grid, densities and body mask to the CT cache of dicom_dir
+    CUDA_HOST
+    void
+    write_ct_cache() {
+        mqi::ct_cache_t ct;
+        ct.series_uid        = this->dcm_.ct->get_series_uid();
+        ct.plan_list         = this->dcm_.plan_list;
+        ct.struct_list       = this->dcm_.struct_list;
+        ct.nx                = this->dcm_.dim_.x;
+        ct.ny                = this->dcm_.dim_.y;
+        ct.nz                = this->dcm_.dim_.z;
+        ct.dx                = this->dcm_.dx;
+        ct.dy                = this->dcm_.dy;
+        ct.dz.assign(this->dcm_.dz, this->dcm_.dz + ct.nz);
+        ct.xe.assign(this->dcm_.xe, this->dcm_.xe + ct.nx + 1);
+        ct.ye.assign(this->dcm_.ye, this->dcm_.ye + ct.ny + 1);
+        ct.ze.assign(this->dcm_.ze, this->dcm_.ze + ct.nz + 1);
+        ct.body_contour_name = this->read_structure ? this->body_contour_name : "";
+        ct.density           = this->ct_density;
+        ct.body_mask         = this->read_structure ? this->dcm_.body_contour : nullptr;
+        uint64_t lut_hash    = mqi::density_lut_hash(this->tx->material_.density_lut());
+        mqi::write_ct_cache(std::filesystem::path(dicom_dir) / mqi::ct_cache_name, this->dicom_files, lut_hash, ct);
+    }
+
     CUDA_HOST
     virtual struct dicom_t
     read_dcm_dir() 
     {
         // Declare DICOM dataset variable
         dicom_t         dcm;
-        gdcm::Directory d;
-        //// Need to check the directory is valid and stop process if not
-        d.Load(dicom_dir.c_str());
+
+        // A valid cache of the CT grid replaces the DICOM scan, the CT decoding and the HU conversion
+        if (this->ct_cache && !this->usingPhantomGeo && this->read_ct_cache(dcm)) return dcm;
+
         std::cout << "Reading DICOM directory.. : DICOM directory name --> " << dicom_dir << std::endl;
-        const gdcm::Directory::FilenamesType& l1 = d.GetFilenames();
-        dcm.nfiles                               = l1.size();
-        gdcm::Scanner   s0;
-
-        // Reading modality tag of DICOM
-        const gdcm::Tag Modality(0x0008, 0x0060);   // Modality
-        s0.AddTag(Modality);
-        bool b = s0.Scan(d.GetFilenames());
-        if (!b) 
-        {
-            std::cerr << "Scanner failed" << std::endl;
-            throw std::runtime_error("Reading DICOM failed.");
-            //            return;
-        }
+        if (!std::filesystem::is_directory(dicom_dir))
+            throw std::runtime_error("Reading DICOM failed. No directory " + dicom_dir);
+
+        // One pass over the headers gives the modality of every file and the CT geometry
+        const mqi::dicom_index_t index =
+          mqi::index_dicom_dir(dicom_dir, this->host_workers, this->dicom_index_cache);
+        dcm.nfiles = index.n_files;
 
         // ----------------------------------------------------------------------------------------------------------
         // Only get the DICOM files:
@@ -437,14 +708,32 @@ public:
         // DICOM RT Struct : for CT masking ROI
         // DICOM CT : for patient geometry
 
-        dcm.plan_list   = s0.GetAllFilenamesFromTagToValue(Modality, "RTPLAN");
-        dcm.struct_list = s0.GetAllFilenamesFromTagToValue(Modality, "RTSTRUCT");
+        dcm.plan_list   = index.files("RTPLAN");
+        dcm.struct_list = index.files("RTSTRUCT");
+
+        // CT pixels and the RT plan are decoded in the background while the CT geometry and
+        // the RT structure are processed here. Without ConcurrentStartup the tasks are deferred
+        // and run where they are joined.
+        // Concurrently, the plan parser takes one host worker and the CT decoding and, when the
+        // structure is read, the contour rasterisation share the others.
+        const std::launch startup_policy =
+          this->concurrent_startup ? std::launch::async : std::launch::deferred;
+        uint32_t ct_workers      = this->host_workers;
+        uint32_t contour_workers = this->host_workers;
+        if (this->concurrent_startup) {
+            uint32_t shared = (this->host_workers > 1) ? this->host_workers - 1 : 1;
+            ct_workers      = this->read_structure ? std::max<uint32_t>(1, shared / 2) : shared;
+            contour_workers = std::max<uint32_t>(1, shared - ct_workers);
+        }
+        std::future<void> ct_loading;
 
         // If user don't use phantom geometry, load DICOM CT files
         if (!this->usingPhantomGeo)
         {
-            dcm.ct          = new mqi::ct<R>(dicom_dir, false);
-            dcm.ct->load_data();
+            dcm.ct          = new mqi::ct<R>(index, false);
+            mqi::ct<R>* ct  = dcm.ct;
+            ct->set_workers(ct_workers);
+            ct_loading      = std::async(startup_policy, [ct]() { ct->load_data(); });
 
             // Get geometry information from CT
             dcm.dim_     = dcm.ct->get_nxyz();
@@ -490,6 +779,7 @@ public:
         }
         //printf("Loading RT Ion plan from %s\n", dcm.plan_name.c_str());
         std::cout << "Reading DICOM directory.. : Loading RT Ion plan data from " << dcm.plan_name << " .." << std::endl;
+        this->start_plan_loading(dcm.plan_name);
         
         if (!this->usingPhantomGeo)
         {
@@ -533,23 +823,11 @@ public:
             dcm.image_center.z = (dcm.org_ze[0] + dcm.org_dz[0] / 2.0 + dcm.org_ze[dcm.dim_.z] - dcm.org_dz[dcm.dim_.z - 1] / 2.0) / 2.0;
         
             // -------------------------------------------------------------------------------------------------------
-            //// TODO: ct clipping check
-            // this->ct_clipping = false;
-            // if (this->ct_clipping) 
-            // {
-            //     //// TODO: ct clipping check
-            //     //            dcm = this->clip_ct(dcm);
-            // } 
-            // else 
-            // {
-               
-            // }
+            // The transport grid is the whole CT here, clip_ct() crops it once the densities are known
             dcm.xe        = dcm.org_xe;
             dcm.ye        = dcm.org_ye;
             dcm.ze        = dcm.org_ze;
             dcm.dz        = dcm.org_dz;
-            this->ct_data = new int16_t[dcm.org_dim_.x * dcm.org_dim_.y * dcm.org_dim_.z];
-            std::copy(begin(dcm.ct->get_data()), end(dcm.ct->get_data()), this->ct_data);
         }
         else
         {
@@ -612,48 +890,44 @@ public:
                 }
             }
             auto     roi_contour_seq = (*struct_ds_)(gdcm::Tag(0x3006, 0x0039));
-            uint8_t* body_contour = new uint8_t[dcm.org_dim_.x * dcm.org_dim_.y * dcm.org_dim_.z];
+            uint8_t* body_contour = new uint8_t[dcm.org_dim_.x * dcm.org_dim_.y * dcm.org_dim_.z]();
             std::vector<int>   refer_roi, contour_num;
             std::vector<float> contour_data;
-            mqi::vec3<float>*  contour_points;
-            int                points_ind;
-            //start = std::chrono::high_resolution_clock::now();
+            std::vector<std::vector<mqi::vec3<float>>> contours;
+            auto start = std::chrono::high_resolution_clock::now();
             for (int con_ind = 0; con_ind < roi_contour_seq.size(); con_ind++) {
                 roi_contour_seq[con_ind]->get_values("ReferencedROINumber", refer_roi);
                 if (refer_roi[0] == body_ind[0]) {
                     auto contour_seq = (*roi_contour_seq[con_ind]) (gdcm::Tag(0x3006, 0x0040));
+                    contours.resize(contour_seq.size());
                     for (int contour_ind = 0; contour_ind < contour_seq.size(); contour_ind++) {
                         contour_seq[contour_ind]->get_values("NumberOfContourPoints", contour_num);
                         contour_seq[contour_ind]->get_values("ContourData", contour_data);
-                        contour_points = new mqi::vec3<float>[contour_num[0]];
-                        for (points_ind = 0; points_ind < contour_num[0]; points_ind++) {
+                        std::vector<mqi::vec3<float>>& contour_points = contours[contour_ind];
+                        contour_points.resize(contour_num[0]);
+                        for (int points_ind = 0; points_ind < contour_num[0]; points_ind++) {
                             contour_points[points_ind].x = contour_data[points_ind * 3];
                             contour_points[points_ind].y = contour_data[points_ind * 3 + 1];
                             contour_points[points_ind].z = contour_data[points_ind * 3 + 2];
                         }
-                        fill_contour(body_contour,
-                                     contour_points,
-                                     contour_num[0],
-                                     dcm.dim_,
-                                     dcm.xe,
-                                     dcm.ye,
-                                     dcm.ze,
-                                     dcm.dx,
-                                     dcm.dy);
-                        delete[] contour_points;
                     }
                     break;
                 }
             }
-            //stop     = std::chrono::high_resolution_clock::now();
-            //duration = stop - start;
-            //printf("Contour conversion to volume: %f ms\n", duration.count());
+            // Contours of a slice are filled together (even-odd), slices in parallel
+            mqi::rasterize_contours(
+              body_contour, contours, dcm.dim_, dcm.xe, dcm.ye, dcm.ze, dcm.dx, dcm.dy, contour_workers);
+            std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+            printf("Contour conversion to volume: %lu contours in %f ms\n", contours.size(), duration.count());
             dcm.body_contour = body_contour;
         } 
         else if (this->read_structure) 
         {
             throw std::runtime_error("RT STRCUTURE does not exist");
         }
+
+        // Join the CT pixel decoding, the constructor converts the pixels to densities
+        if (!this->usingPhantomGeo) ct_loading.get();
         return dcm;
     }
 
@@ -673,86 +947,72 @@ public:
         // Check log file directory is correct
         printf("Reading log file directory.. : Directory name --> %s\n", logfile_dir.c_str());
 
-        std::vector<std::string> fileFolderName;
-
-        /* Get log files data using file system API */
-        std::filesystem::path logFileFolderPath(logfile_dir);
-
-        // Get path of field folders
-        for (const std::filesystem::directory_entry& entry :
-            std::filesystem::directory_iterator(logFileFolderPath)) 
-        {
-            fileFolderName.push_back(entry.path().string());
+        if (beamIndex < 0 || beamIndex >= static_cast<int>(this->log_index.size()))
+            throw std::runtime_error("No log file folder for beam " + std::to_string(beamIndex + 1));
+        const std::vector<std::filesystem::path>& layerFiles = this->log_index[beamIndex].files;
+
+        // Declare log file energy, spot XY, particle count information for each field
+        std::vector<logfile_t> fieldLogFileContainer;
+        std::vector<float> fieldBeamEnergy;
+
+        // Layer files are mapped and parsed concurrently, or loaded from the cache of the field,
+        // unless they were prefetched while the previous beam was transported
+        auto start = std::chrono::high_resolution_clock::now();
+        mqi::log_field_t field;
+        if (this->log_prefetched.valid() && this->log_prefetched_index == beamIndex) {
+            field = this->log_prefetched.get();
+            printf("Reading log files.. : Prefetched during the previous beam\n");
+        } else {
+            field = this->read_log_field(beamIndex);
         }
+        fieldLogFileContainer = std::move(field.layers);
+        fieldBeamEnergy = std::move(field.energy);
+        std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
 
-        std::sort(fileFolderName.begin(), fileFolderName.end());
-
-        // Read log file data (csv) in each field folder
-        for (int i = 0; i < fileFolderName.size(); i++)
+        for (size_t k = 0; k < layerFiles.size(); k++)
         {
-            if (i == beamIndex)
-            {
-                std::filesystem::path p(fileFolderName[i]);
-
-                // Declare log file energy, spot XY, particle count information for each field
-                std::vector<logfile_t> fieldLogFileContainer;
-                std::vector<float> fieldBeamEnergy;
+            logfile_t& selectedLogFiledInfo = fieldLogFileContainer[k];
+            std::cout << "Reading log file information in the field directory.. : " + layerFiles[k].string() + ".." << std::endl;
 
-                std::vector<std::filesystem::path> sortedByName;
-                for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(p)) sortedByName.push_back(entry.path());
-                std::sort(sortedByName.begin(), sortedByName.end());
-
-                for (auto &filename : sortedByName) 
-                {
-                    // Check the reading files are csv
-                    if (filename.extension() == ".csv")
-                    {
-                        // Reading each log file data
-                        std::fstream fs(filename.string());
-                        std::string strBuf;
-
-                        // Get beam energy from file name string
-                        std::string logBeamEnergyString = filename.filename().string();
-                        logBeamEnergyString = logBeamEnergyString.substr(0, logBeamEnergyString.find('.csv') - 1);
-                        logBeamEnergyString = logBeamEnergyString.substr(logBeamEnergyString.find('_') + 1, logBeamEnergyString.find('M') - 2);
-                        float layerBeamEnergy = std::stof(logBeamEnergyString);
-                        fieldBeamEnergy.push_back(layerBeamEnergy);
-
-                        std::cout << "Reading log file information in the field directory.. : " + filename.string() + ".." << std::endl;
-                        
-                        // Declare variable of a log file 
-                        logfile_t selectedLogFiledInfo;
-
-                        int csvIndex = 0;
-
-                        while (!fs.eof())
-                        {
-                            if (std::getline(fs, strBuf, ','))
-                            {
-                                csvIndex += 1; // Add csv index
-
-                                if (csvIndex == 2) selectedLogFiledInfo.posX.push_back(stof(strBuf));
-                                else if (csvIndex == 3) selectedLogFiledInfo.posY.push_back(stof(strBuf));
-                                else if (csvIndex == 4) 
-                                {
-                                    selectedLogFiledInfo.muCount.push_back(stoi(strBuf) * this->particles_per_history);
-                                    csvIndex = 0;
-                                }
-                            }
-                        }
-                        fs.close();
-                        fieldLogFileContainer.push_back(selectedLogFiledInfo);
-                    }
-                }
-                logFileData.beamInfo.push_back(fieldLogFileContainer);
-                logFileData.beamEnergyInfo.push_back(fieldBeamEnergy);
-
-                std::cout << "Reading log file information for beam " << beamIndex + 1 << " is complete!" << std::endl;
+            // Merge repeated samples of the same position into spots
+            if (this->log_spot_tolerance > 0)
+            {
+                size_t nSamples = selectedLogFiledInfo.muCount.size();
+                selectedLogFiledInfo = mqi::aggregate_logfile(selectedLogFiledInfo, this->log_spot_tolerance, this->particles_per_history);
+                printf("Aggregating log file samples.. : %lu samples --> %lu spots\n", nSamples, selectedLogFiledInfo.muCount.size());
             }
         }
+        printf("Reading log files.. : %lu layers in %f ms\n", layerFiles.size(), duration.count());
+        logFileData.beamInfo.push_back(fieldLogFileContainer);
+        logFileData.beamEnergyInfo.push_back(fieldBeamEnergy);
+
+        std::cout << "Reading log file information for beam " << beamIndex + 1 << " is complete!" << std::endl;
         return logFileData;
     }
 
+    ///< Parsed layers of the indexed field folder of a beam
+    CUDA_HOST
+    mqi::log_field_t
+    read_log_field(int beamIndex, uint32_t n_workers = 0) {
+        return mqi::read_log_field(this->log_index[beamIndex],
+                                   this->particles_per_history,
+                                   (n_workers > 0) ? n_workers : this->host_workers,
+                                   this->log_cache);
+    }
+
+    ///< Start reading the logs of a beam in the background, read_logfile_dir picks them up.
+    ///< It overlaps with the world setup or transport, so it only takes a quarter of the host workers.
+    CUDA_HOST
+    void
+    prefetch_logfile_dir(int beamIndex) {
+        if (beamIndex < 0 || beamIndex >= static_cast<int>(this->log_index.size())) return;
+        this->log_prefetched_index = beamIndex;
+        this->log_prefetched =
+          std::async(std::launch::async, [this, beamIndex]() {
+              return this->read_log_field(beamIndex, std::max<uint32_t>(1, this->host_workers / 4));
+          });
+    }
+
     CUDA_HOST
     virtual void
     setup_materials() {
@@ -904,13 +1164,8 @@ public:
                                                     this->dcm_.dim_.y + 1,
                                                     this->dcm_.ze,
                                                     this->dcm_.dim_.z + 1);
-            density_t* rho_mass = new density_t[dcm_.dim_.x * dcm_.dim_.y * dcm_.dim_.z];
-            std::cout << "Creating material information for grid.." << std::endl;
-            for (int i = 0; i < dcm_.dim_.x * dcm_.dim_.y * dcm_.dim_.z; i++) 
-            {
-                rho_mass[i] = this->tx->material_.hu_to_density(this->ct_data[i]);
-            }
-            phantom->geo->set_data(rho_mass);   //// Material conversion function required
+            phantom->geo->set_data(this->ct_density);   ///< converted once in the constructor
+            this->ct_phantom = phantom;
         }
         else // 2. If user uses phantom geometry
         {
@@ -1005,10 +1260,63 @@ public:
             }
         }
 
+        if (this->density_bin_width > 0) {
+            mqi::vec3<ijk_t> nxyz    = phantom->geo->get_nxyz();
+            density_t*       density = phantom->geo->get_data();
+            R                rho_max = 0;
+            for (uint32_t i = 0; i < nxyz.x * nxyz.y * nxyz.z; i++) {
+                if (density[i] > rho_max) rho_max = density[i];
+            }
+            phantom->density_table =
+              mqi::build_density_table<R>(rho_max, this->density_bin_width / 1000.0);
+            std::cout << "Setting phantom.. : Density table, bins --> "
+                      << phantom->density_table.n_bins << std::endl;
+        }
+
+        if (this->woodcock_tracking) {
+            mqi::vec3<ijk_t> nxyz    = phantom->geo->get_nxyz();
+            density_t*       density = phantom->geo->get_data();
+            R                rho_max = 0;
+            for (uint32_t i = 0; i < nxyz.x * nxyz.y * nxyz.z; i++) {
+                if (density[i] > rho_max) rho_max = density[i];
+            }
+            phantom->rho_majorant = rho_max;
+            std::cout << "Setting phantom.. : Woodcock tracking, majorant density --> "
+                      << rho_max * 1000.0 << " g/cm3" << std::endl;
+        }
+
+        if (this->empty_space_skip) {
+            ///< with a body contour only the air outside the body is skipped, not cavities inside
+            mqi::vec3<ijk_t> nxyz = phantom->geo->get_nxyz();
+            const uint8_t*   body =
+              (!this->usingPhantomGeo && this->read_structure) ? this->dcm_.body_contour : nullptr;
+            phantom->empty_space      = mqi::build_empty_space_map(
+              phantom->geo->get_data(), nxyz, this->air_threshold / 1000.0, body);
+            phantom->empty_space_step = mqi::empty_space_step<R>(phantom->geo->get_x_edges(),
+                                                                 phantom->geo->get_y_edges(),
+                                                                 phantom->geo->get_z_edges(),
+                                                                 nxyz);
+            size_t n_empty = 0;
+            for (uint32_t i = 0; i < nxyz.x * nxyz.y * nxyz.z; i++) {
+                if (phantom->empty_space[i] > 0) n_empty++;
+            }
+            std::cout << "Setting phantom.. : Empty space skipping, empty voxels --> " << n_empty
+                      << " / " << nxyz.x * nxyz.y * nxyz.z << (body ? " (body contour)" : "")
+                      << std::endl;
+        }
+
         // Mask reading
         mqi::mask_reader mask_reader0(this->dcm_.dim_);
         roi_t*           roi_tmp;
-        if (scoring_mask) {
+        if (scoring_mask && !this->ct_clip.is_full()) {
+            ///< mask files are on the CT grid
+            mqi::mask_reader ct_masks(this->dcm_.org_dim_);
+            ct_masks.mask_filenames = mask_filenames;
+            ct_masks.read_mask_files();
+            mask_reader0.set_mask(mqi::crop(ct_masks.mask_total, this->ct_clip));
+            delete[] ct_masks.mask_total;
+            roi_tmp = mask_reader0.mask_to_roi();
+        } else if (scoring_mask) {
             mask_reader0.mask_filenames = mask_filenames;
             mask_reader0.read_mask_files();
             roi_tmp = mask_reader0.mask_to_roi();
@@ -1034,18 +1342,39 @@ public:
 #else
         fp0             = mqi::dose_to_water;
 #endif
-        phantom->scorers[0] =
-          new mqi::scorer<R>(this->scorer_string.c_str(),
-                             this->dcm_.dim_.x * this->dcm_.dim_.y * this->dcm_.dim_.z,
-                             fp0);
+        ///< Scorers without spot keys are stored densely over the ROI voxels.
+        ///< This avoids a hash table sized to the whole CT and its scan at output.
+        ///< Variance is only kept in the per-voxel hash tables, so it disables the dense storage.
+        if (this->dense_scorer && this->score_variance)
+            printf("Setting scorer.. : Dense scorer disabled, variance needs the hash table scorer\n");
+        bool use_dense = this->dense_scorer && this->sim_type == mqi::PER_BEAM &&
+                         this->reshape_output && !this->score_variance &&
+                         (this->scorer_type == mqi::DOSE ||
+                          this->scorer_type == mqi::ENERGY_DEPOSITION ||
+                          this->scorer_type == mqi::LETd || this->scorer_type == mqi::LETt);
+        if (use_dense) {
+            phantom->scorers[0]              = new mqi::scorer<R>(this->scorer_string.c_str(), 0, fp0);
+            phantom->scorers[0]->dense_size_ = roi_tmp->get_mask_size();
+            phantom->scorers[0]->dense_      = new double[phantom->scorers[0]->dense_size_]();
+            std::cout << "Setting scorer.. : Dense scorer over ROI voxels --> "
+                      << phantom->scorers[0]->dense_size_ << " ("
+                      << phantom->scorers[0]->dense_size_ * sizeof(double) / (1024.0 * 1024.0)
+                      << " MB)" << std::endl;
+        } else {
+            phantom->scorers[0] =
+              new mqi::scorer<R>(this->scorer_string.c_str(),
+                                 this->dcm_.dim_.x * this->dcm_.dim_.y * this->dcm_.dim_.z,
+                                 fp0);
 
-        mqi::key_value* deposit0 = new mqi::key_value[phantom->scorers[0]->max_capacity_];
+            mqi::key_value* deposit0 = new mqi::key_value[phantom->scorers[0]->max_capacity_];
 
-        std::memset(deposit0, 0xff, sizeof(mqi::key_value) * phantom->scorers[0]->max_capacity_);
+            std::memset(
+              deposit0, 0xff, sizeof(mqi::key_value) * phantom->scorers[0]->max_capacity_);
 
-        init_table(deposit0, phantom->scorers[0]->max_capacity_);
+            init_table(deposit0, phantom->scorers[0]->max_capacity_);
 
-        phantom->scorers[0]->data_           = deposit0;
+            phantom->scorers[0]->data_ = deposit0;
+        }
         phantom->scorers[0]->score_variance_ = this->score_variance;
         phantom->scorers[0]->roi_            = roi_tmp;
 
@@ -1143,13 +1472,32 @@ public:
             this->beam_rng.seed(this->master_seed);
             //printf("bnb %d seed %d\n", this->bnb, this->master_seed);
             this->initialize();
+            if (this->log_prefetch && beam_queue + 1 < beam_numbers.size()) {
+                this->prefetch_logfile_dir(beam_numbers[beam_queue + 1] - 1);
+            }
             this->run();
             this->finalize();
+            this->unclip_outputs();
             if (this->reshape_output) {
                 this->save_reshaped_files();
             } else if (this->sparse_output) {
                 this->save_sparse_file();
             }
+            this->release_node_tables();
+        }
+    }
+
+    ///< Free the host lookup tables of the world's nodes once a beam is saved.
+    ///< Their device copies are freed by mc::download_node.
+    CUDA_HOST
+    void
+    release_node_tables() {
+        for (int c_ind = 0; c_ind < this->world->n_children; c_ind++) {
+            mqi::node_t<R>* c_node = this->world->children[c_ind];
+            delete[] c_node->empty_space;
+            c_node->empty_space = nullptr;
+            delete[] c_node->density_table.bins;
+            c_node->density_table.bins = nullptr;
         }
     }
     CUDA_HOST
@@ -1181,7 +1529,8 @@ public:
     run_simulation(size_t    histories_per_batch,
                    size_t    histories_in_batch,
                    uint32_t* tracked_particles,
-                   uint32_t* scorer_offset_vector = nullptr) {
+                   uint32_t* scorer_offset_vector = nullptr,
+                   size_t    first_history        = 0) {
         /// histories_per_batch and histories_in_batch are kine of redundant.
         /// the histories_per_batch may not required if copying memory work correctly with histories_in_batch
         //auto start = std::chrono::high_resolution_clock::now();
@@ -1262,35 +1611,224 @@ public:
         gpu_err_chk(cudaFree(worker_threads));
         gpu_err_chk(cudaFree(mc::mc_vertices));
 #else
-        n_threads       = 1;
+        ///< workers pause while threads are lent to the batch producer
+        n_threads = mqi::host_threads(this->num_total_threads);
         mc::mc_vertices = this->vertices;
         mc::mc_world    = this->world;
-        /// TODO: number of threads for multithreading implementation
-        worker_threads = new mqi::thrd_t[n_threads];
-        initialize_threads(worker_threads, n_threads, this->master_seed);
-        printf("Thread initialization complete!\n");
-        mc::transport_particles_patient<R>(
-          worker_threads, mc::mc_world, mc::mc_vertices, histories_in_batch, tracked_particles);
+        worker_threads  = new mqi::thrd_t[n_threads];
+        initialize_threads(worker_threads, n_threads, this->master_seed, this->bnb);
+        printf("Thread initialization complete! Host worker threads --> %d, Histories per chunk --> %d\n",
+               n_threads,
+               this->histories_per_chunk);
+        mqi::private_scorer* private_scores =
+          create_private_scorer(n_threads, scorer_offset_vector != nullptr);
+        mc::transport_particles_patient_host<R>(worker_threads,
+                                                n_threads,
+                                                mc::mc_world,
+                                                mc::mc_vertices,
+                                                histories_in_batch,
+                                                tracked_particles,
+                                                scorer_offset_vector,
+                                                this->histories_per_chunk,
+                                                private_scores,
+                                                true,
+                                                first_history,
+                                                &this->producer_workers);
+        if (private_scores) {
+            private_scores->reduce();
+            delete private_scores;
+        }
+        delete[] worker_threads;
 #endif
     }   //run_simulation
 
+#if !defined(__CUDACC__)
+    ///< Private score tiles for the host workers, or nullptr when hits go to the shared tables.
+    ///< Dose and energy deposit map voxels directly, so workers can score into private tiles;
+    ///< per-spot scoring offsets the keys and always uses the shared tables.
+    CUDA_HOST
+    mqi::private_scorer*
+    create_private_scorer(uint32_t n_threads, bool per_spot) {
+        if (!this->private_scoring || n_threads <= 1 || per_spot ||
+            (this->scorer_type != mqi::DOSE && this->scorer_type != mqi::ENERGY_DEPOSITION))
+            return nullptr;
+        mqi::private_scorer* private_scores =
+          new mqi::private_scorer(n_threads, this->private_scoring_mb * 1024 * 1024);
+        for (int c_ind = 0; c_ind < this->world->n_children; c_ind++) {
+            mqi::node_t<R>* c_node = this->world->children[c_ind];
+            for (int s_ind = 0; s_ind < c_node->n_scorers; s_ind++) {
+                mqi::vec3<ijk_t> dim = c_node->geo->get_nxyz();
+                if (c_node->scorers[s_ind]->dense_) {
+                    private_scores->add_dense(c_node->scorers[s_ind]->dense_,
+                                              c_node->scorers[s_ind]->dense_size_);
+                } else {
+                    private_scores->add_table(c_node->scorers[s_ind]->data_,
+                                              dim.x * dim.y * dim.z,
+                                              c_node->scorers[s_ind]->max_capacity_);
+                }
+            }
+        }
+        return private_scores;
+    }
+#endif
+
+    ///< Transport all histories of the beam source without a vertex array (CPU).
+    ///< The beamlets are flattened to a spot table and the workers sample each primary right
+    ///< before transporting it, from the same Philox streams as generate_vertices(), so the
+    ///< result matches a batched run while memory stays constant in the number of histories.
+    ///< Returns false when a beamlet has no flat form or in the GPU build; the caller then
+    ///< falls back to batches.
+    CUDA_HOST
+    bool
+    run_on_the_fly(uint32_t* tracked_particles, bool per_spot) {
+#if defined(__CUDACC__)
+        printf("On-the-fly source sampling is only available on the CPU, running in batches\n");
+        return false;
+#else
+        const size_t                n_spots = this->beamsource.beamlet_size_;
+        mqi::spot_table<R>          spots;
+        std::vector<mqi::mat3x3<R>> rotations(n_spots);
+        std::vector<mqi::vec3<R>>   translations(n_spots);
+        for (size_t i = 0; i < n_spots; ++i) {
+            const mqi::beamlet<R>& bl = std::get<0>(this->beamsource[i]);
+            if (bl.flatten(spots) < 0) {
+                printf("On-the-fly source sampling.. : beamlet %lu has no flat form, running in batches\n", i);
+                return false;
+            }
+            rotations[i]    = bl.get_coordinate_transform().rotation;
+            translations[i] = bl.get_coordinate_transform().translation;
+        }
+        size_t h1 = this->beamsource.total_histories();
+        printf("On-the-fly source sampling.. : %lu spots, %lu histories\n", n_spots, h1);
+        auto         start     = std::chrono::high_resolution_clock::now();
+        uint32_t     n_threads = mqi::host_threads(this->num_total_threads);
+        mqi::thrd_t* worker_threads = new mqi::thrd_t[n_threads];
+        initialize_threads(worker_threads, n_threads, this->master_seed, this->bnb);
+        mc::mc_world                        = this->world;
+        mqi::private_scorer* private_scores = create_private_scorer(n_threads, per_spot);
+        mc::transport_particles_source_host<R>(worker_threads,
+                                               n_threads,
+                                               mc::mc_world,
+                                               &spots.view(),
+                                               rotations.data(),
+                                               translations.data(),
+                                               this->beamsource.array_cdf_,
+                                               n_spots,
+                                               this->master_seed,
+                                               this->bnb | mqi::philox_rng::source_stream,
+                                               per_spot ? this->scorer_size : 0,
+                                               0,
+                                               h1,
+                                               tracked_particles,
+                                               this->histories_per_chunk,
+                                               private_scores);
+        if (private_scores) {
+            private_scores->reduce();
+            delete private_scores;
+        }
+        delete[] worker_threads;
+        std::chrono::duration<double, std::milli> duration =
+          std::chrono::high_resolution_clock::now() - start;
+        printf("run simulation %f ms\n", duration.count());
+        return true;
+#endif
+    }
+
+    ///< Sample histories [first_history, first_history + n) of the beam source into vertices.
+    ///< The range is cut into chunks over the host workers; a chunk finds its first spot in
+    ///< the cumulative history array of the beam source and walks the spots from there.
+    ///< History k of spot s draws from the Philox stream (seed, beam | source_stream) at
+    ///< counter (k, s), so the vertices do not depend on batching or on the number of workers.
+    ///< score_offset_vector, if given, gets the scorer offset of the spot of each history.
     CUDA_HOST
     void
-    read_vertices_spot(size_t                                      history_start,
-                       size_t                                      history_end,
-                       std::tuple<mqi::beamlet<R>, size_t, size_t> bl,
-                       mqi::vertex_t<R>*                           vertices,
-                       uint32_t*                                   score_offset_vector,
-                       int                                         spot_ind,
-                       size_t                                      histories_per_batch) {
-        for (int history_ind = history_start; history_ind < history_end; history_ind++) {
-            vertices[history_ind] = std::get<0>(bl)(&this->beam_rng);
-
-            score_offset_vector[history_ind] =
-              spot_ind * this->scorer_size;   // Store beamlet index for each history
-            assert(history_ind < histories_per_batch);
+    generate_vertices(size_t            first_history,
+                      size_t            n,
+                      mqi::vertex_t<R>* vertices,
+                      uint32_t*         score_offset_vector = nullptr,
+                      uint32_t          n_workers           = 0) {
+        const size_t* cdf     = this->beamsource.array_cdf_;
+        const size_t  n_spots = this->beamsource.beamlet_size_;
+        mqi::parallel_for_chunks(
+          n, 4096, (n_workers > 0) ? n_workers : this->host_workers, [&](uint32_t, size_t begin, size_t end) {
+              mqi::philox_rng rng(this->master_seed, this->bnb | mqi::philox_rng::source_stream);
+              size_t          h    = first_history + begin;
+              size_t          spot = std::upper_bound(cdf, cdf + n_spots, h) - cdf;
+              auto            bl   = this->beamsource[spot];
+              for (size_t i = begin; i < end; ++i, ++h) {
+                  if (h >= cdf[spot]) {
+                      while (h >= cdf[spot])
+                          ++spot;
+                      bl = this->beamsource[spot];
+                  }
+                  rng.start_history(h - (cdf[spot] - std::get<1>(bl)), spot);
+                  vertices[i] = std::get<0>(bl)(&rng);
+                  if (score_offset_vector) score_offset_vector[i] = spot * this->scorer_size;
+              }
+          });
+    }
+
+    ///< Generate and transport histories [0, h1) in num_batches batches of histories_per_batch.
+    ///< Vertex buffers are allocated once and reused; while a batch is transported the next one
+    ///< is generated on a producer thread, with at most batch_buffers batches in memory.
+    ///< On the CPU the producer gets a quarter of the host workers, and as many transport workers
+    ///< pause only while a batch is being generated, so the cores are not oversubscribed and
+    ///< transport runs on all of them otherwise.
+    ///< per_spot also fills the scorer offset of every history for per-spot scoring.
+    CUDA_HOST
+    void
+    run_batches(size_t    h1,
+                size_t    histories_per_batch,
+                size_t    num_batches,
+                uint32_t* tracked_particles,
+                bool      per_spot) {
+        if (num_batches == 0) return;
+        uint32_t n_buffers = std::min<size_t>(std::max<uint32_t>(this->batch_buffers, 1), num_batches);
+        std::vector<mqi::vertex_t<R>*> vertex_pool(n_buffers);
+        std::vector<uint32_t*>         offset_pool(n_buffers, nullptr);
+        for (uint32_t i = 0; i < n_buffers; ++i) {
+            vertex_pool[i] = new mqi::vertex_t<R>[histories_per_batch];
+            if (per_spot) offset_pool[i] = new uint32_t[histories_per_batch];
+        }
+        uint32_t n_producer = this->host_workers;
+        uint32_t n_lent     = 0;   ///< transport workers paused while the producer runs
+#if !defined(__CUDACC__)
+        if (n_buffers > 1) {
+            n_producer = std::max<uint32_t>(1, this->host_workers / 4);
+            n_lent     = n_producer;
+        }
+#endif
+        printf("Generating particles.. : %u batch buffers, %u producer threads\n", n_buffers, n_producer);
+        mqi::pipeline_batches(
+          num_batches,
+          n_buffers,
+          [&](size_t batch, uint32_t buffer) {
+              size_t first_history = batch * histories_per_batch;
+              size_t n             = std::min(histories_per_batch, h1 - first_history);
+              this->producer_workers = n_lent;
+              generate_vertices(first_history, n, vertex_pool[buffer], offset_pool[buffer], n_producer);
+              this->producer_workers = 0;
+          },
+          [&](size_t batch, uint32_t buffer) {
+              size_t first_history = batch * histories_per_batch;
+              size_t n             = std::min(histories_per_batch, h1 - first_history);
+              printf("Transporting particles for (%lu of %lu batches)..\n", batch + 1, num_batches);
+              auto start     = std::chrono::high_resolution_clock::now();
+              this->vertices = vertex_pool[buffer];
+              run_simulation(
+                histories_per_batch, n, tracked_particles, offset_pool[buffer], first_history);
+              std::chrono::duration<double, std::milli> duration =
+                std::chrono::high_resolution_clock::now() - start;
+              printf("run simulation %f ms\n", duration.count());
+          });
+        this->vertices         = nullptr;
+        this->producer_workers = 0;
+        for (uint32_t i = 0; i < n_buffers; ++i) {
+            delete[] vertex_pool[i];
+            delete[] offset_pool[i];
         }
     }
+
     CUDA_HOST
     virtual void
     run_by_beam(mqi::node_t<R>* world = mc::mc_world) {
@@ -1304,8 +1842,7 @@ public:
         tracked_particles[0]        = 0;
 
         int    num_batches;
-        size_t histories_per_batch = 0, cum_vertices = 0;
-        size_t current_vertex = 0;
+        size_t histories_per_batch = 0;
         if (this->max_histories_per_batch <= 0) {
             num_batches         = 1;
             histories_per_batch = (h1 - h0);   // upload all vertices at once
@@ -1315,26 +1852,10 @@ public:
             histories_per_batch = this->max_histories_per_batch;
             std::cout << "Uploading particles with batch.. : Particle count --> " << histories_per_batch << " with " << num_batches << " batches" << std::endl;
         }
-        for (int batch = 0; batch < num_batches; batch++) 
-        {
-            this->vertices = new mqi::vertex_t<R>[histories_per_batch];
-            printf("Generating particles for (%d of %d batches) in CPU ..\n", batch + 1, num_batches);
-            for (current_vertex = 0; current_vertex < histories_per_batch; current_vertex++) 
-            {
-                if (cum_vertices + current_vertex >= (h1 - h0)) { break; }
-                auto bl = this->beamsource(cum_vertices + current_vertex);
-                this->vertices[current_vertex] = bl(&this->beam_rng);   // copy histories to vertices
-            }
-
-            std::cout << "Particle generation complete!" << std::endl;
-            cum_vertices += current_vertex;
-            printf("Transporting particles...\n");
-            run_simulation(histories_per_batch, current_vertex, tracked_particles);
-            std::cout << "Particle transportation complete!" << std::endl;
-            delete[] this->vertices;
-            if (tracked_particles[0] == h1) { break; }
-        }
-
+        if (!this->on_the_fly_source || !run_on_the_fly(tracked_particles, false))
+            run_batches(h1 - h0, histories_per_batch, num_batches, tracked_particles, false);
+        std::cout << "Particle transportation complete!" << std::endl;
+        delete[] tracked_particles;
     }   //run_by_beam
 
     // Change RT file based beam generation to log file based generation
@@ -1346,23 +1867,14 @@ public:
         //// Spot by spot simulation
         /// TODO: faster implementation
         printf("Run by spot\n");
-        std::chrono::time_point<std::chrono::high_resolution_clock> start, stop;
-        std::chrono::duration<double, std::milli>                   duration;
-        size_t                                                      h0 = 0;
-        size_t h1                   = this->beamsource.total_histories();
+        size_t    h0                = 0;
+        size_t    h1                = this->beamsource.total_histories();
         this->num_spots             = this->beamsource.total_beamlets();
-        size_t    max_histories     = 0;
         uint32_t* tracked_particles = new uint32_t[1];
         tracked_particles[0]        = 0;
         printf("num spots %d\n", this->num_spots);
-        size_t    total_history   = 0;
-        uint32_t* spot_boundaries = new uint32_t[this->num_spots];
-        size_t    num_histories, cum_histories = 0;
-        size_t    num_batches, history_ind, loop_end;
-        size_t    cum_vertices = 0, spot_start = 0, batch = 0, spot_ind = 0;
-        size_t    current_history     = 0;   // Number of histories from current spot id
-        size_t    current_vertex      = 0;   // Number of vertex in current batch
-        size_t    histories_per_batch = 0;
+        size_t num_batches;
+        size_t histories_per_batch = 0;
 
         if (this->max_histories_per_batch == 0) {
             num_batches         = 1;
@@ -1376,76 +1888,11 @@ public:
                    num_batches);
         }
 
-        mqi::vertex_t<R>* vertices_test;
-        //        printf("histories per batch %d\n",histories_per_batch);
-        while (spot_ind < this->num_spots) {
-            this->vertices                = new mqi::vertex_t<R>[histories_per_batch];
-            vertices_test                 = new mqi::vertex_t<R>[histories_per_batch];
-            uint32_t* score_offset_vector = new uint32_t[histories_per_batch];
-            //            printf("num batches %d batch %d spot start %d\n",num_batches,batch, spot_start);
-            start = std::chrono::high_resolution_clock::now();
-            printf("Generating particles..\n");
-            for (spot_ind = spot_start; spot_ind < this->num_spots; spot_ind++) {
-                auto bl       = this->beamsource[spot_ind];
-                num_histories = std::get<1>(bl);
-                if (num_histories - current_history < histories_per_batch - current_vertex) {
-                    loop_end = num_histories - current_history + current_vertex;
-                } else {
-                    loop_end = histories_per_batch;
-                }
-                /// The multithreading gives small performance gain if we need run it for each spot
-                ///20 seconds ->  18 seconds
-                read_vertices_spot(current_vertex,
-                                   loop_end,
-                                   bl,
-                                   this->vertices,
-                                   score_offset_vector,
-                                   spot_ind,
-                                   histories_per_batch);
-
-                assert(loop_end > current_vertex);
-                current_history += loop_end - current_vertex;
-                cum_vertices += loop_end - current_vertex;
-                current_vertex += loop_end - current_vertex;
-
-                if (current_vertex == histories_per_batch && current_history < num_histories) {
-                    /// The spot have remaining particles to simulate
-                    spot_start = spot_ind;
-                    break;
-                } else if (current_vertex == histories_per_batch &&
-                           current_history == num_histories) {
-                    /// The spot have no remaining particles to simulate
-                    spot_start = spot_ind + 1;
-                    break;
-                } else {
-                    current_history = 0;
-                }
-            }
-            stop     = std::chrono::high_resolution_clock::now();
-            duration = stop - start;
-
-            //printf("beam generation %f ms\n", duration.count());
-            /// Transport particles
-            printf("Transporting particles..\n");
-            start = std::chrono::high_resolution_clock::now();
-            run_simulation(
-              histories_per_batch, current_vertex, tracked_particles, score_offset_vector);
-            stop     = std::chrono::high_resolution_clock::now();
-            duration = stop - start;
-            printf("run simulation %f ms\n", duration.count());
-            current_vertex = 0;
-            delete[] this->vertices;
-            delete[] score_offset_vector;
-            batch += 1;
-            if (tracked_particles[0] == h1) { break; }
-        }
-        printf("spot ind %lu num_spots %d cum vertices %lu total histories %lu\n",
-               spot_ind,
-               this->num_spots,
-               cum_vertices,
-               h1);
+        if (!this->on_the_fly_source || !run_on_the_fly(tracked_particles, true))
+            run_batches(h1, histories_per_batch, num_batches, tracked_particles, true);
+        printf("num_spots %d total histories %lu\n", this->num_spots, h1);
         printf("Number of particles tracked %d\n", tracked_particles[0]);
-
+        delete[] tracked_particles;
     }   // run_by_spot
 
     virtual mqi::node_t<R>*
@@ -1499,62 +1946,6 @@ public:
 
         return rangeshifter;
     }
-    CUDA_HOST_DEVICE
-    bool
-    sol1_1(mqi::vec2<float> pos, mqi::vec3<float>*& contour_points, int num_points) {
-        mqi::vec3<float> pos0 = contour_points[0];
-        mqi::vec3<float> pos1;
-        float            min_y, max_y, max_x, intersect_x;
-        int              count = 0;
-        int              i, j, c = 0;
-        for (i = 0, j = num_points - 1; i < num_points; j = i++) {
-            pos0 = contour_points[i];
-            pos1 = contour_points[j];
-            if ((((pos0.y <= pos.y) && (pos.y < pos1.y)) ||
-                 ((pos1.y <= pos.y) && (pos.y < pos0.y))) &&
-                (pos.x < (pos1.x - pos0.x) * (pos.y - pos0.y) / (pos1.y - pos0.y) + pos0.x)) {
-                c = !c;
-            }
-        }
-        return c;
-    }
-    CUDA_HOST_DEVICE
-    void
-    fill_contour(uint8_t*           volume_contour,
-                 mqi::vec3<float>*& contour_points,
-                 int                num_contour_points,
-                 mqi::vec3<ijk_t>   dim,
-                 const R*           x_pix,
-                 const R*           y_pix,
-                 const R*           z_pix,
-                 float              dx,
-                 float              dy) {
-        int x_ind = 0, y_ind = 0, z_ind = -1;
-        for (int i = 0; i < dim.z - 1; i++) {
-            if (contour_points[0].z > z_pix[i] && contour_points[0].z < z_pix[i + 1]) {
-                z_ind = i;
-                break;
-            }
-        }
-        mqi::vec2<float> pos;
-        uint32_t         idx = 0;
-        float            x_pos, y_pos;
-        if (z_ind >= 0) {
-            for (x_ind = 0; x_ind < dim.x - 1; x_ind++) {
-                for (y_ind = 0; y_ind < dim.y - 1; y_ind++) {
-                    pos.x = x_pix[x_ind] + dx * 0.5;
-                    pos.y = y_pix[y_ind] + dy * 0.5;
-                    idx   = z_ind * dim.x * dim.y + y_ind * dim.x + x_ind;
-                    assert(idx < dim.x * dim.y * dim.z);
-                    if (sol1_1(pos, contour_points, num_contour_points)) {
-                        volume_contour[idx] = 1;
-                    } else {
-                        //                        volume_contour[idx] = 0;
-                    }
-                }
-            }
-        }
-    }
 
     CUDA_HOST
     double*
@@ -1566,6 +1957,11 @@ public:
         for (int i = 0; i < dim.x * dim.y * dim.z; i++) {
             reshaped_data[i] = 0;
         }
+        if (this->world->children[c_ind]->scorers[s_ind]->dense_) {
+            this->world->children[c_ind]->scorers[s_ind]->dense_to_volume(reshaped_data,
+                                                                          dim.x * dim.y * dim.z);
+            return reshaped_data;
+        }
         //printf("max capacity %d\n", this->world->children[c_ind]->scorers[s_ind]->max_capacity_);
         for (int ind = 0; ind < this->world->children[c_ind]->scorers[s_ind]->max_capacity_;
              ind++) {
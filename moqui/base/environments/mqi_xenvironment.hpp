@@ -54,7 +54,7 @@ public:
     std::string output_path   = "";
     std::string output_format = "";
 
-    std::default_random_engine beam_rng;
+    mqi::philox_rng beam_rng;
     CUDA_HOST
     x_environment() {
         ;
@@ -157,6 +157,11 @@ public:
         for (int i = 0; i < dim.x * dim.y * dim.z; i++) {
             reshaped_data[i] = 0;
         }
+        if (this->world->children[c_ind]->scorers[s_ind]->dense_) {
+            this->world->children[c_ind]->scorers[s_ind]->dense_to_volume(reshaped_data,
+                                                                          dim.x * dim.y * dim.z);
+            return reshaped_data;
+        }
         //printf("max capacity %d\n", this->world->children[c_ind]->scorers[s_ind]->max_capacity_);
         for (int ind = 0; ind < this->world->children[c_ind]->scorers[s_ind]->max_capacity_;
              ind++) {
@@ -0,0 +1,131 @@
+#ifndef MQI_DENSITY_TABLE_HPP
+#define MQI_DENSITY_TABLE_HPP
+
+/// \file
+///
+/// Density dependent terms of the water-equivalent patient material.
+/// The stopping power ratio and the radiation length only depend on the voxel density,
+/// so they are tabulated once per phantom and looked up in the stepping loop
+/// instead of evaluating pow() and log() at every step.
+
+#include <cmath>
+#include <cstdint>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_physics_constants.hpp>
+
+namespace mqi
+{
+
+///< Terms of one density, stopping power ratio = spr0 + spr1 * Ek + spr2 * Ek^-0.3421
+template<typename R>
+struct density_terms_t {
+    R spr0   = 0;
+    R spr1   = 0;
+    R spr2   = 0;
+    R inv_X0 = 0;   ///< 1 / radiation length (1/mm)
+};
+
+///< Fippel's density regions: vacuum, lung/air, lung to soft tissue, tissue and bone
+CUDA_HOST_DEVICE
+inline int
+density_region(float rho_gcm3) {
+    if (rho_gcm3 < 0.0012f) return 0;
+    if (rho_gcm3 <= 0.26f) return 1;
+    if (rho_gcm3 <= 0.9f) return 2;
+    return 3;
+}
+
+///< Exact terms for rho_mass (g/mm^3), same models as
+///< material_t::stopping_power_ratio() and p_ionization::radiation_length()
+template<typename R>
+CUDA_HOST_DEVICE inline density_terms_t<R>
+density_terms(R rho_mass) {
+    physics_constants<R> units;
+    density_terms_t<R>   t;
+    R                    rho = rho_mass * 1000.0;   ///< g/cm^3
+    R                    f   = 0.0;
+    switch (density_region(rho)) {
+    case 0:
+        f = 0.9857 + 0.0085 * rho;
+        break;
+    case 1:
+        t.spr0 = 0.8815 + (rho - 0.0012) * (0.9925 - 0.8815) / (0.26 - 0.0012);
+        f      = 0.9857 + 0.0085 * rho;
+        break;
+    case 2: {
+        ///< interpolation between 0.9925 at 0.26 and the tissue fit at 0.9 g/cm^3
+        R w    = (rho - 0.26) / (0.9 - 0.26);
+        R a    = 0.291 * (powf(static_cast<float>(rho), -0.7f) - 1.0);
+        t.spr0 = (1.0 - w) * 0.9925 + w * (1.0123 + a);
+        t.spr1 = -3.386e-5 * w;
+        t.spr2 = w * a;
+        f      = 1.0446 - 0.2180 * rho;
+        break;
+    }
+    default:
+        t.spr0 = 1.0;
+        f      = 1.19 + 0.44 * logf(static_cast<float>(rho - 0.44));
+        break;
+    }
+    t.inv_X0 = (rho * 0.001 * f) / (units.water_density * units.radiation_length_water);
+    return t;
+}
+
+///< Density terms sampled every bin width from 0 to the maximum density of a phantom.
+///< Lookups interpolate linearly between the two neighbouring samples; bins that
+///< contain a region boundary, where the terms are not continuous, are evaluated exactly.
+template<typename R>
+struct density_table_t {
+    density_terms_t<R>* bins      = nullptr;   ///< n_bins samples, bins[i] at i / inv_width
+    uint32_t            n_bins    = 0;
+    R                   inv_width = 0;   ///< 1 / bin width (mm^3/g)
+    uint32_t            split[3]  = { 0, 0, 0 };   ///< bins containing a region boundary
+
+    CUDA_HOST_DEVICE
+    density_terms_t<R>
+    lookup(R rho_mass) const {
+        R x = rho_mass * inv_width;
+        if (bins == nullptr || !(x >= 0) || x >= n_bins - 1) return density_terms<R>(rho_mass);
+        uint32_t i = static_cast<uint32_t>(x);
+        if (i == split[0] || i == split[1] || i == split[2]) return density_terms<R>(rho_mass);
+        R                         w  = x - i;
+        const density_terms_t<R>& b0 = bins[i];
+        const density_terms_t<R>& b1 = bins[i + 1];
+        density_terms_t<R>        t;
+        t.spr0   = b0.spr0 + w * (b1.spr0 - b0.spr0);
+        t.spr1   = b0.spr1 + w * (b1.spr1 - b0.spr1);
+        t.spr2   = b0.spr2 + w * (b1.spr2 - b0.spr2);
+        t.inv_X0 = b0.inv_X0 + w * (b1.inv_X0 - b0.inv_X0);
+        return t;
+    }
+};
+
+///< Tabulate the terms up to rho_max (g/mm^3) every bin_width (g/mm^3).
+///< The caller owns table.bins.
+template<typename R>
+CUDA_HOST density_table_t<R>
+build_density_table(R rho_max, R bin_width) {
+    density_table_t<R> table;
+    table.inv_width = 1.0 / bin_width;
+    table.n_bins    = static_cast<uint32_t>(std::ceil(rho_max * table.inv_width)) + 2;
+    table.bins      = new density_terms_t<R>[table.n_bins];
+    for (uint32_t i = 0; i < table.n_bins; ++i) {
+        table.bins[i] = density_terms<R>(i * bin_width);
+    }
+    ///< unused entries point past the last bin
+    uint8_t n_split = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        table.split[i] = table.n_bins;
+    }
+    for (uint32_t i = 0; i + 1 < table.n_bins && n_split < 3; ++i) {
+        if (density_region(i * bin_width * 1000.0) != density_region((i + 1) * bin_width * 1000.0)) {
+            table.split[n_split++] = i;
+        }
+    }
+    return table;
+}
+
+}   // namespace mqi
+
+#endif
@@ -4,6 +4,7 @@
 #include <moqui/base/mqi_common.hpp>
 #include <moqui/base/mqi_math.hpp>
 #include <moqui/base/mqi_physics_constants.hpp>
+#include <moqui/base/materials/mqi_density_table.hpp>
 #include "moqui/base/materials/material_table_data.hpp"
 
 #include <cmath>
@@ -37,6 +38,9 @@ public:
     R        Iev_sq;               //Iev * Iev for stopping power calculation
     R        X0;                   //Radiation length
     uint16_t id;
+
+    R                  rho_terms = -1;   ///< density of terms, see set_density()
+    density_terms_t<R> terms;            ///< stopping power ratio and radiation length terms
 public:
     CUDA_HOST_DEVICE
     material_t() { ; }
@@ -55,9 +59,34 @@ public:
         electrons          = r.electrons;
         Iev                = r.Iev;
         X0                 = r.X0;
+        rho_terms          = r.rho_terms;
+        terms              = r.terms;
         return *this;
     }
 
+    ///< Set the density and its stopping power ratio and radiation length terms.
+    ///< The terms are kept while the density does not change (e.g. steps in one voxel)
+    ///< and come from the node's density table when it has one.
+    CUDA_HOST_DEVICE
+    inline void
+    set_density(R rho, const density_table_t<R>& table) {
+        rho_mass = rho;
+        if (rho_terms == rho) return;
+        terms     = table.lookup(rho);
+        rho_terms = rho;
+    }
+
+    ///< 1 / radiation length (1/mm) of the current density
+    CUDA_HOST_DEVICE
+    inline R
+    inverse_radiation_length() {
+        if (rho_terms != rho_mass) {
+            terms     = density_terms<R>(rho_mass);
+            rho_terms = rho_mass;
+        }
+        return terms.inv_X0;
+    }
+
     ///< variable density
     CUDA_HOST_DEVICE
     inline virtual R
@@ -82,6 +111,11 @@ public:
     CUDA_DEVICE
     inline virtual R
     stopping_power_ratio(R Ek, int8_t id = -1) {
+        if (rho_terms == this->rho_mass) {
+            R rsp = terms.spr0 + terms.spr1 * Ek;
+            if (terms.spr2 != 0) rsp += terms.spr2 * mqi::mqi_pow(Ek, static_cast<R>(-0.3421));
+            return rsp;
+        }
         ////< 0.9 g/cm^3 ->  g/mm^3
         R density_tmp = this->rho_mass * 1000.0;
 
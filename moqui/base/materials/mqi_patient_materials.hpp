@@ -2,8 +2,10 @@
 #define MQI_PATIENT_MATERIAL_HPP
 
 #include <cassert>
+#include <vector>
 #include <moqui/base/materials/mqi_material.hpp>
 #include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_parallel.hpp>
 #include <moqui/base/mqi_physics_constants.hpp>
 
 namespace mqi
@@ -18,6 +20,9 @@ class patient_material_t : public h2o_t<R>
 {
 
 public:
+    static const int16_t hu_min = -1000;   ///< hu_to_density() clamps HU to [hu_min, hu_max]
+    static const int16_t hu_max = 6000;
+
     CUDA_HOST_DEVICE
     patient_material_t() : h2o_t<R>() {
         ;
@@ -76,6 +81,33 @@ public:
         rho_mass /= 1000.0;   ///g/mm3
         return rho_mass;
     }
+
+    ///< hu_to_density() of every HU in [hu_min, hu_max], indexed by hu - hu_min
+    CUDA_HOST
+    std::vector<mqi::density_t>
+    density_lut() {
+        std::vector<mqi::density_t> lut(hu_max - hu_min + 1);
+        for (int32_t hu = hu_min; hu <= hu_max; ++hu) {
+            lut[hu - hu_min] = this->hu_to_density(hu);
+        }
+        return lut;
+    }
+
+    ///< Convert n CT values to densities (g/mm^3) through density_lut(),
+    ///< split in blocks over n_workers host threads
+    CUDA_HOST
+    void
+    hu_to_density(const int16_t* hu, mqi::density_t* density, size_t n, uint32_t n_workers) {
+        const std::vector<mqi::density_t> lut   = this->density_lut();
+        const mqi::density_t*             table = lut.data();
+        mqi::parallel_for_chunks(n, 1 << 16, n_workers, [&](uint32_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                int32_t h  = hu[i];
+                h          = (h < hu_min) ? hu_min : (h > hu_max) ? hu_max : h;
+                density[i] = table[h - hu_min];
+            }
+        });
+    }
 };
 
 }   // namespace mqi
@@ -0,0 +1,100 @@
+#ifndef MQI_BATCH_PIPELINE_HPP
+#define MQI_BATCH_PIPELINE_HPP
+
+/// \file
+///
+/// Two stage pipeline for batched runs on the host.
+/// A producer thread fills batch N+1 into a free buffer while the calling thread
+/// consumes (transports) batch N. Buffers come from a fixed pool owned by the caller,
+/// so the producer stalls when all of them are waiting to be consumed.
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace mqi
+{
+
+///< Run fill(batch, buffer) and consume(batch, buffer) for batch in [0, n_batches).
+///< buffer is an index in [0, n_buffers) into the caller's pool; batches are consumed in order
+///< and a buffer is only handed to fill() again after consume() returned.
+///< With a single buffer or batch the stages simply alternate on the calling thread.
+///< The first exception of either stage stops the pipeline and is rethrown.
+template<typename Fill, typename Consume>
+void
+pipeline_batches(size_t n_batches, uint32_t n_buffers, Fill&& fill, Consume&& consume) {
+    if (n_batches == 0) return;
+    if (n_buffers <= 1 || n_batches == 1) {
+        for (size_t b = 0; b < n_batches; ++b) {
+            fill(b, 0u);
+            consume(b, 0u);
+        }
+        return;
+    }
+
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::deque<uint32_t>    free_buffers;
+    std::deque<uint32_t>    ready_buffers;   ///< filled, in batch order
+    bool                    abort = false;
+    std::exception_ptr      error = nullptr;
+    for (uint32_t i = 0; i < n_buffers; ++i) {
+        free_buffers.push_back(i);
+    }
+
+    auto stop = [&]() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error) error = std::current_exception();
+        abort = true;
+        cv.notify_all();
+    };
+
+    std::thread producer([&]() {
+        try {
+            for (size_t b = 0; b < n_batches; ++b) {
+                uint32_t buffer;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [&]() { return abort || !free_buffers.empty(); });
+                    if (abort) return;
+                    buffer = free_buffers.front();
+                    free_buffers.pop_front();
+                }
+                fill(b, buffer);
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    ready_buffers.push_back(buffer);
+                }
+                cv.notify_all();
+            }
+        } catch (...) { stop(); }
+    });
+
+    try {
+        for (size_t b = 0; b < n_batches; ++b) {
+            uint32_t buffer;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]() { return abort || !ready_buffers.empty(); });
+                if (abort) break;
+                buffer = ready_buffers.front();
+                ready_buffers.pop_front();
+            }
+            consume(b, buffer);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                free_buffers.push_back(buffer);
+            }
+            cv.notify_all();
+        }
+    } catch (...) { stop(); }
+    producer.join();
+    if (error) std::rethrow_exception(error);
+}
+
+}   // namespace mqi
+
+#endif
@@ -7,6 +7,8 @@
 /// \see http://dicom.nema.org/medical/dicom/current/output/chtml/part03/sect_C.8.8.25.html for RTI
 /// \see http://dicom.nema.org/medical/dicom/current/output/chtml/part03/sect_C.8.8.26.html for RTIBTR
 
+#include <cmath>
+
 #include <moqui/base/mqi_beam_module.hpp>
 
 namespace mqi
@@ -29,7 +31,10 @@ struct logfile_t
     {
         std::vector<float> posX;
         std::vector<float> posY;
-        std::vector<int> muCount;
+        std::vector<int> muCount;    // Particles of each sample (or spot), MU * particles per history
+        std::vector<double> mu;      // MU count of each sample (or spot) before scaling
+        std::vector<float> time;     // Delivery time of each sample (or first sample of a spot)
+        std::vector<int> nSamples;   // Samples merged into each spot, empty unless aggregated
     };
     
 struct logfiles_t
@@ -38,6 +43,47 @@ struct logfiles_t
         std::vector<std::vector<logfile_t>> beamInfo;
     };
 
+    // Merge consecutive samples into one spot at the MU weighted mean position.
+    // A sample joins the current spot while it is within tolerance (mm) of the running weighted
+    // mean of the spot on both axes, so a slow drift is split where it leaves that box.
+    // The raw MU of the samples is summed and scaled by particles_per_history and rounded once
+    // per spot, so small samples do not each lose their fraction of a particle.
+    // The time of a spot is the time of its first sample, nSamples keeps the sample count,
+    // so the per-sample timeline can still be recovered from the unmerged file when needed.
+inline logfile_t
+aggregate_logfile(const logfile_t& samples, float tolerance, float particles_per_history)
+    {
+        logfile_t spots;
+        size_t n = samples.mu.size();
+        size_t i = 0;
+        while (i < n)
+        {
+            double sumX = 0, sumY = 0, sumMU = 0;
+            double meanX = samples.posX[i], meanY = samples.posY[i];
+            size_t j = i;
+            for (; j < n; j++)
+            {
+                if (std::abs(samples.posX[j] - meanX) > tolerance || std::abs(samples.posY[j] - meanY) > tolerance) break;
+                sumX += double(samples.posX[j]) * samples.mu[j];
+                sumY += double(samples.posY[j]) * samples.mu[j];
+                sumMU += samples.mu[j];
+                if (sumMU > 0)
+                {
+                    meanX = sumX / sumMU;
+                    meanY = sumY / sumMU;
+                }
+            }
+            spots.posX.push_back(meanX);
+            spots.posY.push_back(meanY);
+            spots.mu.push_back(sumMU);
+            spots.muCount.push_back(int(std::lround(sumMU * particles_per_history)));
+            if (i < samples.time.size()) spots.time.push_back(samples.time[i]);
+            spots.nSamples.push_back(int(j - i));
+            i = j;
+        }
+        return spots;
+    }
+
 /// \class beam_module_ion
 ///  A class for the RTION beams (plan & treatment record)
 
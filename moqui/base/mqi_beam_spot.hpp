@@ -0,0 +1,243 @@
+#ifndef MQI_BEAM_SPOT_HPP
+#define MQI_BEAM_SPOT_HPP
+
+/// \file
+///
+/// Flat table of pencil beam spots with a gaussian energy and a phsp_6d_ray fluence.
+/// Spots are stored as a struct of arrays: the mean position and direction per spot and an
+/// index into models, the parameter sets shared by all spots of a layer with the same energy,
+/// spot size, spreads and source position. Models keep the sampling coefficients of phsp_6d_ray
+/// precomputed, so sampling a spot is a few multiply-adds without virtual calls or heap objects.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_matrix.hpp>
+#include <moqui/base/mqi_philox.hpp>
+#include <moqui/base/mqi_vec.hpp>
+#include <moqui/base/mqi_vertex.hpp>
+
+namespace mqi
+{
+
+///< Plain view of a spot table, see spot_table for the storage.
+template<typename R>
+struct spot_table_t {
+    uint32_t n_spots = 0;
+    ///< per spot
+    const R*        x     = nullptr;   ///< mean position
+    const R*        y     = nullptr;
+    const R*        z     = nullptr;
+    const R*        dx    = nullptr;   ///< mean direction
+    const R*        dy    = nullptr;
+    const R*        dz    = nullptr;
+    const uint32_t* model = nullptr;
+    ///< per model
+    const R* e_mean  = nullptr;   ///< MeV
+    const R* e_sigma = nullptr;
+    const R* pos_x   = nullptr;   ///< position sigma at the source position
+    const R* pos_y   = nullptr;
+    const R* pos_z   = nullptr;
+    const R* dir_x   = nullptr;   ///< direction shift per unit position deviate (correlation)
+    const R* dir_y   = nullptr;
+    const R* th_x    = nullptr;   ///< angular sigma of the uncorrelated part
+    const R* th_y    = nullptr;
+
+    ///< Sample spot i in beam coordinates.
+    ///< Same random numbers in the same order as beamlet with norm_1d and phsp_6d_ray.
+    template<typename G>
+    CUDA_HOST_DEVICE mqi::vertex_t<R>
+    operator()(uint32_t i, G& rng) const {
+        const uint32_t m  = model[i];
+        R              Ux = static_cast<R>(rng.normal());
+        R              Vx = static_cast<R>(rng.normal());
+        R              Uy = static_cast<R>(rng.normal());
+        R              Vy = static_cast<R>(rng.normal());
+        R              Uz = static_cast<R>(rng.normal());
+
+        mqi::vertex_t<R> vtx;
+        vtx.pos.x = x[i] + pos_x[m] * Ux;
+        vtx.pos.y = y[i] + pos_y[m] * Uy;
+        vtx.pos.z = z[i] + pos_z[m] * Uz;
+        R u       = dx[i] + dir_x[m] * Ux;
+        R v       = dy[i] + dir_y[m] * Uy;
+        R norm    = std::sqrt(u * u + v * v + dz[i] * dz[i]);
+        u /= norm;
+        v /= norm;
+        vtx.dir.x = u * std::cos(Vx * th_x[m]) + std::sqrt(1 - u * u) * std::sin(Vx * th_x[m]);
+        vtx.dir.y = v * std::cos(Vy * th_y[m]) + std::sqrt(1 - v * v) * std::sin(Vy * th_y[m]);
+        vtx.dir.z = -1.0 * std::sqrt(1.0 - vtx.dir.x * vtx.dir.x - vtx.dir.y * vtx.dir.y);
+        vtx.ke    = e_mean[m] + e_sigma[m] * static_cast<R>(rng.normal());
+        return vtx;
+    }
+};
+
+///< Host storage of a spot table. Spots are appended one by one and models with
+///< identical parameters are shared. view() stays valid until the next add_spot().
+template<typename R>
+class spot_table
+{
+public:
+    ///< e_mean, e_sigma, sigma[6], rho[2], source_position
+    typedef std::array<R, 11> model_key;
+
+protected:
+    std::vector<R>                  x_, y_, z_, dx_, dy_, dz_;
+    std::vector<uint32_t>           model_;
+    std::vector<R>                  e_mean_, e_sigma_, pos_x_, pos_y_, pos_z_;
+    std::vector<R>                  dir_x_, dir_y_, th_x_, th_y_;
+    std::vector<model_key>          keys_;
+    std::map<model_key, uint32_t>   models_;
+    spot_table_t<R>                 view_;
+
+    ///< Coefficients of phsp_6d_ray for one plane, propagated to source position z
+    static void
+    coefficients(double sigma, double sigma_dir, double rho, double z, R& pos, R& dir, R& th) {
+        double A0   = rho * rho;
+        double A1   = sigma_dir;
+        double A2   = sigma * sigma + 2 * A1 * z + A0 * z * z;
+        A1          = A1 + A0 * z;
+        double th20 = 2 * A0;
+        dir         = 0;
+        if (A2 > 0.0) {
+            dir = std::sqrt(A2) * A1 / A2;
+            th20 -= 2.0 * A1 * A1 / A2;
+        }
+        pos = std::sqrt(A2);
+        th  = std::sqrt(th20 / 2);
+    }
+
+    uint32_t
+    add_model(const model_key& key) {
+        auto it = models_.find(key);
+        if (it != models_.end()) return it->second;
+        uint32_t m = keys_.size();
+        keys_.push_back(key);
+        models_.insert(std::make_pair(key, m));
+        R pos, dir, th;
+        e_mean_.push_back(key[0]);
+        e_sigma_.push_back(key[1]);
+        coefficients(key[2], key[5], key[8], key[10], pos, dir, th);
+        pos_x_.push_back(pos);
+        dir_x_.push_back(dir);
+        th_x_.push_back(th);
+        coefficients(key[3], key[6], key[9], key[10], pos, dir, th);
+        pos_y_.push_back(pos);
+        dir_y_.push_back(dir);
+        th_y_.push_back(th);
+        pos_z_.push_back(key[4]);
+        return m;
+    }
+
+    void
+    update_view() {
+        view_.n_spots = model_.size();
+        view_.x       = x_.data();
+        view_.y       = y_.data();
+        view_.z       = z_.data();
+        view_.dx      = dx_.data();
+        view_.dy      = dy_.data();
+        view_.dz      = dz_.data();
+        view_.model   = model_.data();
+        view_.e_mean  = e_mean_.data();
+        view_.e_sigma = e_sigma_.data();
+        view_.pos_x   = pos_x_.data();
+        view_.pos_y   = pos_y_.data();
+        view_.pos_z   = pos_z_.data();
+        view_.dir_x   = dir_x_.data();
+        view_.dir_y   = dir_y_.data();
+        view_.th_x    = th_x_.data();
+        view_.th_y    = th_y_.data();
+    }
+
+public:
+    spot_table() {
+        update_view();
+    }
+
+    spot_table(const spot_table<R>&) = delete;
+    spot_table<R>&
+    operator=(const spot_table<R>&) = delete;
+
+    ///< Append a spot with the parameters of norm_1d and phsp_6d_ray, returns its index
+    uint32_t
+    add_spot(R                       e_mean,
+             R                       e_sigma,
+             const std::array<R, 6>& mean,
+             const std::array<R, 6>& sigma,
+             const std::array<R, 2>& rho,
+             R                       source_position) {
+        model_key key = { e_mean,   e_sigma,  sigma[0], sigma[1], sigma[2],       sigma[3],
+                          sigma[4], sigma[5], rho[0],   rho[1],   source_position };
+        model_.push_back(add_model(key));
+        x_.push_back(mean[0]);
+        y_.push_back(mean[1]);
+        z_.push_back(mean[2]);
+        dx_.push_back(mean[3]);
+        dy_.push_back(mean[4]);
+        dz_.push_back(mean[5]);
+        update_view();
+        return model_.size() - 1;
+    }
+
+    ///< Append spot i of another table, returns its index
+    uint32_t
+    add_spot(const spot_table<R>& other, uint32_t i) {
+        const model_key& k     = other.keys_[other.model_[i]];
+        std::array<R, 6> mean  = { other.x_[i],  other.y_[i],  other.z_[i],
+                                   other.dx_[i], other.dy_[i], other.dz_[i] };
+        std::array<R, 6> sigma = { k[2], k[3], k[4], k[5], k[6], k[7] };
+        std::array<R, 2> rho   = { k[8], k[9] };
+        return add_spot(k[0], k[1], mean, sigma, rho, k[10]);
+    }
+
+    const spot_table_t<R>&
+    view() const {
+        return view_;
+    }
+
+    size_t
+    size() const {
+        return model_.size();
+    }
+
+    size_t
+    n_models() const {
+        return keys_.size();
+    }
+};
+
+///< Histories [first, first + n) of one spot, the work item of on-the-fly transport.
+///< History k of the spot is sampled from the Philox stream (seed, stream) at counter
+///< (k, spot_id), the same stream that beamsource vertex generation uses.
+template<typename R>
+struct spot_histories_t {
+    const spot_table_t<R>* table        = nullptr;
+    uint32_t               spot_id      = 0;   ///< spot in table and beamsource
+    uint64_t               first        = 0;   ///< index of the first history within the spot
+    uint32_t               score_offset = 0;   ///< scorer offset (spot_ind) of the histories
+    uint64_t               seed         = 0;
+    uint32_t               stream       = 0;
+    mqi::mat3x3<R>         rotation;           ///< beam to world coordinates
+    mqi::vec3<R>           translation;
+
+    ///< Primary vertex of history first + i
+    CUDA_HOST
+    mqi::vertex_t<R>
+    sample(uint64_t i) const {
+        mqi::philox_rng rng(seed, stream);
+        rng.start_history(first + i, spot_id);
+        mqi::vertex_t<R> vtx = (*table)(spot_id, rng);
+        vtx.pos              = rotation * vtx.pos + translation;
+        vtx.dir              = rotation * vtx.dir;
+        return vtx;
+    }
+};
+
+}   // namespace mqi
+
+#endif
@@ -13,6 +13,7 @@
 #include <random>
 #include <tuple>
 
+#include <moqui/base/mqi_beam_spot.hpp>
 #include <moqui/base/mqi_coordinate_transform.hpp>
 #include <moqui/base/mqi_distributions.hpp>
 #include <moqui/base/mqi_vertex.hpp>
@@ -43,6 +44,10 @@ protected:
     /// Coordinate transform to map local generation to patient or treatment coordination.
     coordinate_transform<T> p_coord;
 
+    /// Flat spot table and spot index, used instead of energy and fluence when set
+    const mqi::spot_table<T>* spots = nullptr;
+    uint32_t                  spot  = 0;
+
 public:
     /// Construct a beam from the distributions of energy and fluence.
     CUDA_HOST_DEVICE
@@ -50,6 +55,12 @@ public:
         ;
     }
 
+    /// Construct a beam from spot i of a spot table, the table must outlive the beamlet.
+    CUDA_HOST
+    beamlet(const mqi::spot_table<T>* table, uint32_t i) : spots(table), spot(i) {
+        ;
+    }
+
     /// Destructor
     /// \note Do we need to de-allocate the energy and fluence distribution here?
     CUDA_HOST_DEVICE
@@ -63,6 +74,8 @@ public:
         energy  = rhs.energy;
         fluence = rhs.fluence;
         p_coord = rhs.p_coord;
+        spots   = rhs.spots;
+        spot    = rhs.spot;
     }
 
     /// Set coordinate transform from outside.
@@ -73,19 +86,45 @@ public:
         p_coord = p;
     }
 
+    /// Returns coordinate transform
+    CUDA_HOST_DEVICE
+    const coordinate_transform<T>&
+    get_coordinate_transform() const {
+        return p_coord;
+    }
+
+    /// Append this beamlet to a spot table for on-the-fly sampling
+    /// \param table spot table to append to
+    /// \return index of the spot in table, -1 unless the beamlet is a table spot or
+    /// its energy is norm_1d and its fluence phsp_6d_ray
+    CUDA_HOST
+    int64_t
+    flatten(mqi::spot_table<T>& table) const {
+        if (spots) return table.add_spot(*spots, spot);
+        auto e = dynamic_cast<const mqi::norm_1d<T>*>(energy);
+        auto f = dynamic_cast<const mqi::phsp_6d_ray<T>*>(fluence);
+        if (e == nullptr || f == nullptr) return -1;
+        return table.add_spot(
+          e->mean()[0], e->sigma()[0], f->mean(), f->sigma(), f->rho(), f->get_source_position());
+    }
+
     /// Samples energy, position, direction of a history
     /// \param no
     /// \return a tuple of energy, position(vec3), direction (vec3)
     //    CUDA_HOST_DEVICE
     virtual mqi::vertex_t<T>
-    operator()(std::default_random_engine* rng) {
-        std::array<T, 6> phsp = (*fluence)(rng);
-        mqi::vec3<T>     pos(phsp[0], phsp[1], phsp[2]);
-        mqi::vec3<T>     dir(phsp[3], phsp[4], phsp[5]);
+    operator()(mqi::philox_rng* rng) {
         mqi::vertex_t<T> vtx;
-        vtx.ke  = (*energy)(rng)[0];
-        vtx.pos = p_coord.rotation * pos + p_coord.translation;
-        vtx.dir = p_coord.rotation * dir;
+        if (spots) {
+            vtx = spots->view()(spot, *rng);
+        } else {
+            std::array<T, 6> phsp = (*fluence)(rng);
+            vtx.pos               = mqi::vec3<T>(phsp[0], phsp[1], phsp[2]);
+            vtx.dir               = mqi::vec3<T>(phsp[3], phsp[4], phsp[5]);
+            vtx.ke                = (*energy)(rng)[0];
+        }
+        vtx.pos = p_coord.rotation * vtx.pos + p_coord.translation;
+        vtx.dir = p_coord.rotation * vtx.dir;
         return vtx;
     };
 };
@@ -4,7 +4,10 @@
 /// \file
 ///
 /// A beamsource is a collection of beamlets and provides an interface for sampling.
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <vector>
 #include <moqui/base/mqi_beamlet.hpp>
 
 namespace mqi
@@ -25,15 +28,41 @@ public:
     /// A lookup table to map a history to beamlet id.
     /// note: To run GPU, this std::map needs to be replaced GPU compatible data structure.
     std::map<size_t, size_t> cdf2beamlet_;
-    size_t*                  array_cdf_;
-    size_t*                  array_beamlet_;
-    size_t                   beamlet_size_;
-    mqi::beamlet<T>*         array_beamlets;
+    size_t*                  array_cdf_     = nullptr;   ///< accumulated histories per beamlet
+    size_t*                  array_beamlet_ = nullptr;   ///< beamlet id of array_cdf_ entries
+    size_t                   beamlet_size_  = 0;
+    mqi::beamlet<T>*         array_beamlets = nullptr;
     /// A lookup table to map a time to beamlet id.
     //time,  beamlet_id
     //beamlet_id is -1 for no beam pulse
     std::map<T, int32_t> timeline_;
 
+    /// Flat spots referenced by beamlets of a spot table, shared by copies of the source
+    std::shared_ptr<mqi::spot_table<T>> spot_table_;
+
+protected:
+    /// Storage of array_cdf_ and array_beamlet_
+    std::vector<size_t> cdf_;
+    std::vector<size_t> beamlet_ids_;
+
+    /// Point array_cdf_ and array_beamlet_ to the storage
+    void
+    update_arrays() {
+        array_cdf_     = cdf_.data();
+        array_beamlet_ = beamlet_ids_.data();
+        beamlet_size_  = cdf_.size();
+    }
+
+    /// Append to the flat cdf arrays
+    void
+    append_cdf(size_t acc, size_t beamlet_id) {
+        cdf_.push_back(acc);
+        beamlet_ids_.push_back(beamlet_id);
+        update_arrays();
+    }
+
+public:
+
     /// Default constructor
     beamsource() {
         beamlets_.clear();
@@ -41,6 +70,32 @@ public:
         cdf2beamlet_.clear();
     }
 
+    /// Copy constructor, the flat arrays point to the copied storage
+    beamsource(const beamsource<T>& rhs) {
+        *this = rhs;
+    }
+
+    beamsource<T>&
+    operator=(const beamsource<T>& rhs) {
+        beamlets_      = rhs.beamlets_;
+        cdf2beamlet_   = rhs.cdf2beamlet_;
+        array_beamlets = rhs.array_beamlets;
+        timeline_      = rhs.timeline_;
+        spot_table_    = rhs.spot_table_;
+        cdf_           = rhs.cdf_;
+        beamlet_ids_   = rhs.beamlet_ids_;
+        update_arrays();
+        return *this;
+    }
+
+    /// Returns the spot table of this source, created on first use.
+    /// Beamlets made from it stay valid as long as a copy of the source exists.
+    mqi::spot_table<T>&
+    spot_table() {
+        if (!spot_table_) spot_table_ = std::make_shared<mqi::spot_table<T>>();
+        return *spot_table_;
+    }
+
     /// Add a beamlet to internal containers
     /// \param b a beamlet
     /// \param h number of histories
@@ -68,6 +123,7 @@ public:
         const size_t acc = total_histories() + h;
         const size_t beamlet_id = this->total_beamlets();   //current number of beamlets -> beamlet ID
         cdf2beamlet_.insert(std::make_pair(acc, beamlet_id));
+        append_cdf(acc, beamlet_id);
         beamlets_.push_back(std::make_tuple(b, h, acc));
 
         T acc_time = this->total_delivery_time() + logfileTime;
@@ -83,6 +139,7 @@ public:
         const size_t beamlet_id =
           this->total_beamlets();   //current number of beamlets -> beamlet ID
         cdf2beamlet_.insert(std::make_pair(acc, beamlet_id));
+        append_cdf(acc, beamlet_id);
         beamlets_.push_back(std::make_tuple(b, h, acc));
 
         T acc_time = this->total_delivery_time() + time_on;
@@ -126,8 +183,14 @@ public:
     /// \return a beamlet reference (const)
     const mqi::beamlet<T>&
     operator()(size_t h) {
-        size_t beamlet_id = cdf2beamlet_.upper_bound(h)->second;
-        return std::get<0>(beamlets_[beamlet_id]);
+        return std::get<0>(beamlets_[beamlet_of(h)]);
+    }
+
+    /// Returns the beamlet id of a history by bisection of the flat cdf array
+    size_t
+    beamlet_of(size_t h) const {
+        size_t i = std::upper_bound(array_cdf_, array_cdf_ + beamlet_size_, h) - array_cdf_;
+        return array_beamlet_[i];
     }
 
     /// Calculate number of accumulated histories up to given time
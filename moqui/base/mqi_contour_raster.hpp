@@ -0,0 +1,108 @@
+#ifndef MQI_CONTOUR_RASTER_HPP
+#define MQI_CONTOUR_RASTER_HPP
+
+/// \file
+///
+/// Scanline rasterisation of RT structure contours onto a CT grid.
+/// Contours are grouped by slice and every slice is filled from an edge table: each polygon edge
+/// is bucketed into the rows whose voxel centres it crosses, so a row only looks at its own
+/// crossings instead of testing every voxel against every vertex. All contours of a slice share
+/// one edge table and are filled with the even-odd rule, so inner contours cut holes.
+/// Slices are independent and filled by host worker threads.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_parallel.hpp>
+#include <moqui/base/mqi_vec.hpp>
+
+namespace mqi
+{
+
+///< Slice of grid edges ze that contains z strictly, or -1.
+///< The last slice is never selected, like the original point-in-polygon fill.
+template<typename R>
+int
+contour_slice(float z, const R* ze, ijk_t nz) {
+    if (nz < 2) return -1;
+    int i = int(std::upper_bound(ze, ze + nz, z) - ze) - 1;
+    if (i < 0 || i >= nz - 1) return -1;
+    return (z > ze[i] && z < ze[i + 1]) ? i : -1;
+}
+
+///< Set the voxels of volume (dim) whose centres are inside the contours to 1.
+///< xe, ye, ze are voxel edges and dx, dy the pixel size. Voxel centres of the last column
+///< and row are not tested, matching the former point-in-polygon fill point for point.
+template<typename R>
+void
+rasterize_contours(uint8_t*                                    volume,
+                   const std::vector<std::vector<vec3<float>>>& contours,
+                   const mqi::vec3<ijk_t>&                     dim,
+                   const R*                                    xe,
+                   const R*                                    ye,
+                   const R*                                    ze,
+                   float                                       dx,
+                   float                                       dy,
+                   uint32_t                                    n_workers) {
+    if (dim.x < 2 || dim.y < 2) return;
+
+    ///< contours of each slice, a contour lies in the slice of its first point
+    std::vector<std::vector<uint32_t>> by_slice(dim.z);
+    std::vector<int>                   slices;
+    for (uint32_t c = 0; c < contours.size(); ++c) {
+        if (contours[c].empty()) continue;
+        int k = contour_slice(contours[c][0].z, ze, dim.z);
+        if (k < 0) continue;
+        if (by_slice[k].empty()) slices.push_back(k);
+        by_slice[k].push_back(c);
+    }
+
+    ///< voxel centres, computed like the point-in-polygon fill did
+    std::vector<float> cx(dim.x - 1), cy(dim.y - 1);
+    for (ijk_t i = 0; i < dim.x - 1; ++i) {
+        cx[i] = xe[i] + dx * 0.5;
+    }
+    for (ijk_t j = 0; j < dim.y - 1; ++j) {
+        cy[j] = ye[j] + dy * 0.5;
+    }
+
+    mqi::parallel_for(slices.size(), n_workers, [&](size_t s) {
+        const int                       k = slices[s];
+        std::vector<std::vector<float>> crossings(cy.size());
+        for (uint32_t c : by_slice[k]) {
+            const std::vector<vec3<float>>& p = contours[c];
+            const size_t                    n = p.size();
+            for (size_t i = 0, j = n - 1; i < n; j = i++) {
+                const vec3<float>& p0 = p[i];
+                const vec3<float>& p1 = p[j];
+                if (p0.y == p1.y) continue;
+                ///< rows with min(y) <= cy < max(y)
+                float  lo    = std::min(p0.y, p1.y);
+                float  hi    = std::max(p0.y, p1.y);
+                size_t first = std::lower_bound(cy.begin(), cy.end(), lo) - cy.begin();
+                size_t last  = std::lower_bound(cy.begin(), cy.end(), hi) - cy.begin();
+                for (size_t r = first; r < last; ++r) {
+                    crossings[r].push_back((p1.x - p0.x) * (cy[r] - p0.y) / (p1.y - p0.y) + p0.x);
+                }
+            }
+        }
+        uint8_t* plane = volume + size_t(k) * dim.x * dim.y;
+        for (size_t r = 0; r < crossings.size(); ++r) {
+            std::vector<float>& xs = crossings[r];
+            if (xs.size() < 2) continue;
+            std::sort(xs.begin(), xs.end());
+            ///< a centre is inside when an odd number of crossings lie at or left of it
+            for (size_t m = 0; m + 1 < xs.size(); m += 2) {
+                size_t i0 = std::lower_bound(cx.begin(), cx.end(), xs[m]) - cx.begin();
+                size_t i1 = std::lower_bound(cx.begin(), cx.end(), xs[m + 1]) - cx.begin();
+                std::fill(plane + r * dim.x + i0, plane + r * dim.x + i1, 1);
+            }
+        }
+    });
+}
+
+}   // namespace mqi
+
+#endif
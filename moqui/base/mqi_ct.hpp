@@ -7,12 +7,11 @@
 #include <sys/stat.h>
 
 #include "gdcmAttribute.h"
-#include "gdcmDirectory.h"
-#include "gdcmIPPSorter.h"
 #include "gdcmImageReader.h"
-#include "gdcmScanner.h"
 
+#include <moqui/base/mqi_dicom_index.hpp>
 #include <moqui/base/mqi_matrix.hpp>
+#include <moqui/base/mqi_parallel.hpp>
 #include <moqui/base/mqi_rect3d.hpp>
 
 namespace mqi
@@ -29,12 +28,16 @@ protected:
 
     std::map<std::string, std::string> uid2file_;   ///< SOP instance UID to id in files_
 
+    std::string series_uid_;   ///< series instance UID of the first image
+
     char* ct_dir;   ///< directory for CT files
 
     R  dx_;   ///< pixel size in X
     R  dy_;   ///< pixel size in Y
     R* dz_;   // pixel size in Z, it is array to deal with varying pixel
 
+    uint32_t n_workers_ = 1;   ///< threads decoding slices in load_data()
+
 public:
     /// Default constructor
     CUDA_HOST
@@ -48,36 +51,50 @@ public:
     /// \note this method sets only dimensions and extensions.
     /// \see load_data() to read in pixel data
     CUDA_HOST
-    ct(std::string f, bool is_print = false) {
-        ct_dir = new char[f.length() + 1];
-        strcpy(ct_dir, f.c_str());
-        //http://gdcm.sourceforge.net/html/SortImage_8cxx-example.html#_a5
-        gdcm::Directory dir;
-        dir.Load(this->ct_dir, false);   ///< non-recursive
-
-        const gdcm::Directory::FilenamesType& all_files = dir.GetFilenames();
-
-        gdcm::Scanner   scanner;
-        const gdcm::Tag ct_tag = gdcm::Tag(0x08, 0x60);
-        scanner.AddTag(ct_tag);
-        scanner.Scan(all_files);
-
-        auto ct_files = scanner.GetAllFilenamesFromTagToValue(ct_tag, "CT");
-
-        gdcm::IPPSorter ippsorter;
-        ippsorter.SetComputeZSpacing(false);
-        ippsorter.Sort(ct_files);   ///< asending along z
-        files_ = ippsorter.GetFilenames();
+    ct(std::string f, bool is_print = false) : ct(mqi::index_dicom_dir(f, 1, false), is_print) {}
 
-        gdcm::Scanner s;
-        s.AddTag(gdcm::Tag(0x0008, 0x0018));   ///< SOP instance UID
-        s.AddTag(gdcm::Tag(0x0020, 0x0032));   ///< Image Position (Patient)
-        s.AddTag(gdcm::Tag(0x0028, 0x0010));   ///< Rows
-        s.AddTag(gdcm::Tag(0x0028, 0x0011));   ///< Columns
-        s.AddTag(gdcm::Tag(0x0028, 0x0030));   ///< Pixel spacing
-        s.AddTag(gdcm::Tag(0x0018, 0x0050));   ///< Slice thickness
-
-        if (!s.Scan(files_)) assert("scan fail.");
+    /// Constructs the grid from the CT images of a DICOM directory index
+    /// \param index header index of the CT directory
+    /// \param is_print set true if you want to print out files
+    CUDA_HOST
+    ct(const dicom_index_t& index, bool is_print = false) {
+        ct_dir = new char[index.dir.length() + 1];
+        strcpy(ct_dir, index.dir.c_str());
+
+        ///< ascending along the slice normal, like gdcm::IPPSorter
+        ///< http://gdcm.sourceforge.net/html/SortImage_8cxx-example.html#_a5
+        auto split = [](const std::string& str) {
+            std::vector<double> v;
+            for (size_t start = 0; !str.empty();) {
+                size_t end = str.find('\\', start);
+                v.push_back(std::stod(str.substr(start, end - start)));
+                if (end == std::string::npos) break;
+                start = end + 1;
+            }
+            return v;
+        };
+        std::vector<std::pair<double, const dicom_entry_t*>> slices;
+        for (const dicom_entry_t* image : index.find("CT")) {
+            std::vector<double> ipp = split(image->image_position);
+            std::vector<double> iop = split(image->image_orientation);
+            if (ipp.size() != 3) throw std::runtime_error("No image position in " + image->file);
+            double normal[3] = { 0, 0, 1 };
+            if (iop.size() == 6) {
+                normal[0] = iop[1] * iop[5] - iop[2] * iop[4];
+                normal[1] = iop[2] * iop[3] - iop[0] * iop[5];
+                normal[2] = iop[0] * iop[4] - iop[1] * iop[3];
+            }
+            slices.push_back(
+              std::make_pair(normal[0] * ipp[0] + normal[1] * ipp[1] + normal[2] * ipp[2], image));
+        }
+        std::stable_sort(slices.begin(), slices.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        if (slices.empty()) throw std::runtime_error("No CT images in " + index.dir);
+        for (const auto& slice : slices) {
+            files_.push_back(slice.second->file);
+            if (is_print) std::cout << slice.second->file << std::endl;
+        }
 
         size_t nx;                   ///< columns
         size_t ny;                   ///< rows
@@ -89,31 +106,32 @@ public:
         dz_ = new R[nz];
         float dz;
         for (size_t i = 0; i < nz; ++i) {
-            gdcm::Scanner::TagToValue const& m0 = s.GetMapping(files_[i].c_str());
+            const dicom_entry_t& m0 = *slices[i].second;
 
-            std::string  img_position(m0.find(gdcm::Tag(0x0020, 0x0032))->second);
+            std::string  img_position(m0.image_position);
             unsigned int deli0        = img_position.find_first_of('\\');
             unsigned int deli1        = img_position.find_last_of('\\');
             rect3d<int16_t, R>::z_[i] = (R) (std::stod(img_position.substr(deli1 + 1)));
-            dz_[i]                    = std::stod(m0.find(gdcm::Tag(0x0018, 0x0050))->second);
+            dz_[i]                    = std::stod(m0.slice_thickness);
 
             ///< We only determine rows, colums, x0, y0, dx, and dy with first image
             if (i == 0) {
                 x0 = std::stod(img_position.substr(0, deli0));
                 y0 = std::stod(img_position.substr(deli0 + 1, deli1 - deli0));
 
-                ny                         = std::stoi(m0.find(gdcm::Tag(0x0028, 0x0010))->second);
-                nx                         = std::stoi(m0.find(gdcm::Tag(0x0028, 0x0011))->second);
+                ny                         = m0.rows;
+                nx                         = m0.columns;
                 rect3d<int16_t, R>::dim_.x = nx;
                 rect3d<int16_t, R>::dim_.y = ny;
-                std::string  pixel_spacing(m0.find(gdcm::Tag(0x0028, 0x0030))->second);
+                std::string  pixel_spacing(m0.pixel_spacing);
                 unsigned int deli = pixel_spacing.find_first_of('\\');
                 dx_               = std::stod(pixel_spacing.substr(0, deli));
                 dy_               = std::stod(pixel_spacing.substr(deli + 1));
+                series_uid_       = m0.series_uid;
             }
 
             ///< A map to search file path upon instance UID
-            uid2file_.insert(std::make_pair(m0.find(gdcm::Tag(0x0008, 0x0018))->second, files_[i]));
+            uid2file_.insert(std::make_pair(m0.sop_uid, files_[i]));
         }
 
         rect3d<int16_t, R>::x_ = new R[nx];
@@ -136,7 +154,10 @@ public:
                   << std::endl;
     }
 
-    /// Load patient's image to volume
+    /// Load patient's image to volume.
+    /// Slices are decoded by n_workers threads, each straight into its place in data_, and
+    /// rescaled to HU with the slope and intercept of the slice while it is still in cache.
+    /// Compressed slices are decompressed by the worker that reads them.
     CUDA_HOST
     virtual void
     load_data() {
@@ -145,35 +166,46 @@ public:
         size_t nb_voxels_3d = nb_voxels_2d * rect3d<int16_t, R>::dim_.z;
 
         rect3d<int16_t, R>::data_.resize(nb_voxels_3d);
-        float intercept = 0;
-        float slope     = 1;
-
-        for (size_t i = 0; i < rect3d<int16_t, R>::dim_.z; ++i) {
 
+        mqi::parallel_for(rect3d<int16_t, R>::dim_.z, n_workers_, [&](size_t i) {
             gdcm::ImageReader reader;
             reader.SetFileName(files_[i].c_str());
-            reader.Read();
+            if (!reader.Read()) throw std::runtime_error("Can not read CT slice " + files_[i]);
             const gdcm::Image& img = reader.GetImage();
 
-            //n_x * n_y * bytes = img.GetBufferLength()
-            intercept = float(img.GetIntercept());
-            slope     = float(img.GetSlope());
-
-            gdcm::PixelFormat pixeltype = img.GetPixelFormat();
+            if (img.GetPixelFormat() != gdcm::PixelFormat::INT16)
+                throw std::runtime_error("CT slice is not INT16 " + files_[i]);
+            if (img.GetBufferLength() != nb_voxels_2d * sizeof(int16_t))
+                throw std::runtime_error("CT slice size differs from the first slice " + files_[i]);
 
-            switch (pixeltype) {
-            case gdcm::PixelFormat::INT16: {
-                img.GetBuffer((char*) &rect3d<int16_t, R>::data_[i * nb_voxels_2d]);
-            } break;
-            default:
-                assert(0);
-            }   //switch
+            int16_t* slice = &rect3d<int16_t, R>::data_[i * nb_voxels_2d];
+            img.GetBuffer((char*) slice);
 
-        }   //for
-        rect3d<int16_t, R>::data_ = rect3d<int16_t, R>::data_ * int16_t(slope) + intercept;
+            ///< same integer arithmetic as data_ * int16_t(slope) + intercept
+            int16_t slope     = int16_t(float(img.GetSlope()));
+            int16_t intercept = int16_t(float(img.GetIntercept()));
+            if (slope == 1 && intercept == 0) return;
+            for (size_t j = 0; j < nb_voxels_2d; ++j) {
+                slice[j] = int16_t(slice[j] * slope + intercept);
+            }
+        });
         std::cout << "Reading DICOM directory.. : Patient CT pixel data successfully loaded." << std::endl;
     }
 
+    /// Free the pixel data once it was converted, the grid information is kept
+    CUDA_HOST
+    void
+    release_data() {
+        rect3d<int16_t, R>::data_ = std::valarray<int16_t>();
+    }
+
+    /// Set the number of threads decoding slices
+    CUDA_HOST
+    void
+    set_workers(uint32_t n_workers) {
+        n_workers_ = (n_workers > 0) ? n_workers : 1;
+    }
+
     /// Returns x-index for given x position
     inline virtual size_t
     find_c000_x_index(const R& x) {
@@ -192,6 +224,11 @@ public:
         return floor(y / dy_);
     }
 
+    inline const std::string&
+    get_series_uid() const {
+        return series_uid_;
+    }
+
     inline virtual R
     get_dx() {
         return dx_;
@@ -0,0 +1,232 @@
+#ifndef MQI_CT_CACHE_HPP
+#define MQI_CT_CACHE_HPP
+
+/// \file
+///
+/// On-disk cache of the patient transport grid built from a DICOM directory.
+/// The cache keeps the voxel edges, the densities after HU conversion and optionally the
+/// body mask, together with the RT plan and structure file names of the directory.
+/// It is keyed by the name, size and modification time of every file in the directory and
+/// by a hash of the HU to density table, so a changed series or conversion curve rebuilds it.
+/// A valid cache is memory mapped and the grid arrays point straight into the mapping.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_mapped_file.hpp>
+
+namespace mqi
+{
+
+const char     ct_cache_name[]  = ".moqui_ct_cache";
+const char     ct_cache_magic[] = "MQICT01";   ///< 8 bytes with the terminating zero
+const uint32_t ct_cache_version = 1;
+const size_t   ct_cache_align   = 64;          ///< alignment of the voxel arrays in the file
+
+///< Transport grid of a CT series as stored in the cache
+struct ct_cache_t {
+    std::string              series_uid;
+    std::vector<std::string> plan_list;
+    std::vector<std::string> struct_list;
+    int32_t                  nx = 0, ny = 0, nz = 0;
+    float                    dx = 0, dy = 0;
+    std::vector<float>       dz;   ///< nz slice thicknesses
+    std::vector<float>       xe;   ///< nx + 1 edges
+    std::vector<float>       ye;
+    std::vector<float>       ze;
+    std::string              body_contour_name;   ///< ROI of body_mask, empty without a mask
+    mqi::density_t*          density   = nullptr;   ///< nx * ny * nz, points into map when read
+    uint8_t*                 body_mask = nullptr;
+    std::unique_ptr<mqi::mapped_file> map;   ///< keeps density and body_mask of a read cache
+};
+
+///< FNV-1a hash of a HU to density table
+inline uint64_t
+density_lut_hash(const std::vector<mqi::density_t>& lut) {
+    uint64_t             h = 1469598103934665603ull;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(lut.data());
+    for (size_t i = 0; i < lut.size() * sizeof(mqi::density_t); ++i) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+///< Map the cache into ct.
+///< Returns false if there is no cache or it was written for other files, another density
+///< table, another format version, or without the body mask of body_contour_name when one
+///< is requested (an empty name requests no mask).
+inline bool
+read_ct_cache(const std::filesystem::path&   cache,
+              const std::vector<file_key_t>& files,
+              uint64_t                       lut_hash,
+              const std::string&             body_contour_name,
+              ct_cache_t&                    ct) {
+    if (!std::filesystem::exists(cache)) return false;
+    ct.map.reset(new mqi::mapped_file(cache.string(), true));
+    const char* begin = ct.map->begin();
+    const char* p     = begin;
+    const char* end   = ct.map->end();
+    auto        take  = [&](void* dst, size_t n) {
+        if (size_t(end - p) < n) return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+    auto take_string = [&](std::string& str) {
+        uint32_t len;
+        if (!take(&len, 4) || size_t(end - p) < len) return false;
+        str.assign(p, len);
+        p += len;
+        return true;
+    };
+    auto take_strings = [&](std::vector<std::string>& strs) {
+        uint32_t n;
+        if (!take(&n, 4)) return false;
+        strs.resize(n);
+        for (std::string& str : strs) {
+            if (!take_string(str)) return false;
+        }
+        return true;
+    };
+    auto take_floats = [&](std::vector<float>& v, size_t n) {
+        v.resize(n);
+        return take(v.data(), n * sizeof(float));
+    };
+    auto skip_to_aligned = [&]() {
+        size_t offset = ((p - begin) + ct_cache_align - 1) / ct_cache_align * ct_cache_align;
+        if (offset > size_t(end - begin)) return false;
+        p = begin + offset;
+        return true;
+    };
+
+    char     magic[sizeof(ct_cache_magic)];
+    uint32_t version, density_size, n_files;
+    uint64_t hash;
+    if (!take(magic, sizeof(magic)) || std::memcmp(magic, ct_cache_magic, sizeof(magic)) != 0 ||
+        !take(&version, 4) || version != ct_cache_version || !take(&density_size, 4) ||
+        density_size != sizeof(mqi::density_t) || !take(&hash, 8) || hash != lut_hash ||
+        !take(&n_files, 4) || n_files != files.size())
+        return false;
+    for (const file_key_t& key : files) {
+        std::string name;
+        uint64_t    size;
+        int64_t     mtime;
+        if (!take_string(name) || name != key.name || !take(&size, 8) || size != key.size ||
+            !take(&mtime, 8) || mtime != key.mtime)
+            return false;
+    }
+    if (!take_string(ct.series_uid) || !take_strings(ct.plan_list) ||
+        !take_strings(ct.struct_list) || !take_string(ct.body_contour_name) ||
+        ct.body_contour_name != body_contour_name)
+        return false;
+    if (!take(&ct.nx, 4) || !take(&ct.ny, 4) || !take(&ct.nz, 4) || ct.nx <= 0 || ct.ny <= 0 ||
+        ct.nz <= 0 || !take(&ct.dx, 4) || !take(&ct.dy, 4) || !take_floats(ct.dz, ct.nz) ||
+        !take_floats(ct.xe, ct.nx + 1) || !take_floats(ct.ye, ct.ny + 1) ||
+        !take_floats(ct.ze, ct.nz + 1))
+        return false;
+
+    size_t n_voxels = size_t(ct.nx) * ct.ny * ct.nz;
+    if (!skip_to_aligned() || size_t(end - p) < n_voxels * sizeof(mqi::density_t)) return false;
+    ct.density = reinterpret_cast<mqi::density_t*>(ct.map->writable_data() + (p - begin));
+    p += n_voxels * sizeof(mqi::density_t);
+    if (!body_contour_name.empty()) {
+        if (!skip_to_aligned() || size_t(end - p) < n_voxels) return false;
+        ct.body_mask = reinterpret_cast<uint8_t*>(ct.map->writable_data() + (p - begin));
+        p += n_voxels;
+    }
+    return p == end;
+}
+
+///< Write the cache of ct, replacing an old one atomically.
+///< A cache that can not be written, e.g. in a read-only DICOM directory, is skipped.
+inline void
+write_ct_cache(const std::filesystem::path&   cache,
+               const std::vector<file_key_t>& files,
+               uint64_t                       lut_hash,
+               const ct_cache_t&              ct) {
+    std::filesystem::path tmp = cache;
+    tmp += ".tmp";
+    {
+        std::ofstream fs(tmp, std::ios::binary | std::ios::trunc);
+        if (!fs) {
+            printf("Writing CT cache.. : Can not write %s, skipped\n", tmp.string().c_str());
+            return;
+        }
+        uint64_t written = 0;
+        auto     put     = [&](const void* src, size_t n) {
+            fs.write(reinterpret_cast<const char*>(src), n);
+            written += n;
+        };
+        auto put_string = [&](const std::string& str) {
+            uint32_t len = str.size();
+            put(&len, 4);
+            put(str.data(), len);
+        };
+        auto put_strings = [&](const std::vector<std::string>& strs) {
+            uint32_t n = strs.size();
+            put(&n, 4);
+            for (const std::string& str : strs) {
+                put_string(str);
+            }
+        };
+        auto pad_to_aligned = [&]() {
+            const char zeros[ct_cache_align] = {};
+            put(zeros, (ct_cache_align - written % ct_cache_align) % ct_cache_align);
+        };
+
+        uint32_t density_size = sizeof(mqi::density_t);
+        uint32_t n_files      = files.size();
+        put(ct_cache_magic, sizeof(ct_cache_magic));
+        put(&ct_cache_version, 4);
+        put(&density_size, 4);
+        put(&lut_hash, 8);
+        put(&n_files, 4);
+        for (const file_key_t& key : files) {
+            put_string(key.name);
+            put(&key.size, 8);
+            put(&key.mtime, 8);
+        }
+        put_string(ct.series_uid);
+        put_strings(ct.plan_list);
+        put_strings(ct.struct_list);
+        put_string(ct.body_contour_name);
+        put(&ct.nx, 4);
+        put(&ct.ny, 4);
+        put(&ct.nz, 4);
+        put(&ct.dx, 4);
+        put(&ct.dy, 4);
+        put(ct.dz.data(), ct.nz * sizeof(float));
+        put(ct.xe.data(), (ct.nx + 1) * sizeof(float));
+        put(ct.ye.data(), (ct.ny + 1) * sizeof(float));
+        put(ct.ze.data(), (ct.nz + 1) * sizeof(float));
+
+        size_t n_voxels = size_t(ct.nx) * ct.ny * ct.nz;
+        pad_to_aligned();
+        put(ct.density, n_voxels * sizeof(mqi::density_t));
+        if (!ct.body_contour_name.empty()) {
+            pad_to_aligned();
+            put(ct.body_mask, n_voxels);
+        }
+        if (!fs) {
+            printf("Writing CT cache.. : Failed to write %s, skipped\n", tmp.string().c_str());
+            fs.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, cache, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+}   // namespace mqi
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef MQI_CT_CLIP_HPP
+#define MQI_CT_CLIP_HPP
+
+/// \file
+///
+/// Clipping of the patient grid to the box that holds the patient.
+/// The transport grid is cropped to the bounding box of the body, from the body contour or a
+/// density threshold, plus a margin. Scorer indices of the clipped grid are mapped back to the
+/// original CT grid before the results are written.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_roi.hpp>
+#include <moqui/base/mqi_scorer.hpp>
+#include <moqui/base/mqi_vec.hpp>
+
+namespace mqi
+{
+
+///< Voxel box of a clipped grid inside the original grid
+struct clip_box_t {
+    mqi::vec3<ijk_t> shift;     ///< first voxel of the box in the original grid
+    mqi::vec3<ijk_t> dim;       ///< voxels of the box
+    mqi::vec3<ijk_t> org_dim;   ///< voxels of the original grid
+
+    size_t
+    n_voxels() const {
+        return size_t(dim.x) * dim.y * dim.z;
+    }
+
+    bool
+    is_full() const {
+        return dim.x == org_dim.x && dim.y == org_dim.y && dim.z == org_dim.z;
+    }
+
+    ///< Index in the original grid of voxel v of the box
+    uint32_t
+    to_original(uint32_t v) const {
+        uint32_t i = v % dim.x;
+        uint32_t j = (v / dim.x) % dim.y;
+        uint32_t k = v / (dim.x * dim.y);
+        return ((k + shift.z) * org_dim.y + j + shift.y) * org_dim.x + i + shift.x;
+    }
+};
+
+///< Bounding box of the voxels v of dim with inside(v), grown by margin voxels per axis and
+///< limited to the grid. Without such voxels the box is the whole grid.
+template<typename F>
+clip_box_t
+bounding_box(const mqi::vec3<ijk_t>& dim, const mqi::vec3<ijk_t>& margin, F&& inside) {
+    mqi::vec3<ijk_t> lo(dim.x, dim.y, dim.z);
+    mqi::vec3<ijk_t> hi(-1, -1, -1);
+    size_t           v = 0;
+    for (ijk_t k = 0; k < dim.z; ++k) {
+        for (ijk_t j = 0; j < dim.y; ++j) {
+            for (ijk_t i = 0; i < dim.x; ++i, ++v) {
+                if (!inside(v)) continue;
+                lo.x = std::min(lo.x, i);
+                lo.y = std::min(lo.y, j);
+                lo.z = std::min(lo.z, k);
+                hi.x = std::max(hi.x, i);
+                hi.y = std::max(hi.y, j);
+                hi.z = std::max(hi.z, k);
+            }
+        }
+    }
+    clip_box_t box;
+    box.org_dim = dim;
+    if (hi.x < 0) {
+        box.shift = mqi::vec3<ijk_t>(0, 0, 0);
+        box.dim   = dim;
+        return box;
+    }
+    box.shift.x = std::max<ijk_t>(lo.x - margin.x, 0);
+    box.shift.y = std::max<ijk_t>(lo.y - margin.y, 0);
+    box.shift.z = std::max<ijk_t>(lo.z - margin.z, 0);
+    box.dim.x   = std::min<ijk_t>(hi.x + margin.x, dim.x - 1) - box.shift.x + 1;
+    box.dim.y   = std::min<ijk_t>(hi.y + margin.y, dim.y - 1) - box.shift.y + 1;
+    box.dim.z   = std::min<ijk_t>(hi.z + margin.z, dim.z - 1) - box.shift.z + 1;
+    return box;
+}
+
+///< Copy of the voxels of box from a volume of the original grid
+template<typename T>
+T*
+crop(const T* src, const clip_box_t& box) {
+    T*     dst = new T[box.n_voxels()];
+    size_t row = 0;
+    for (ijk_t k = 0; k < box.dim.z; ++k) {
+        for (ijk_t j = 0; j < box.dim.y; ++j, ++row) {
+            const T* first = src + box.to_original(row * box.dim.x);
+            std::copy(first, first + box.dim.x, dst + row * box.dim.x);
+        }
+    }
+    return dst;
+}
+
+///< ROI of the original grid with the scorer indices of roi of the box
+inline roi_t*
+unclip_roi(const roi_t* roi, uint32_t dense_size, const clip_box_t& box) {
+    uint32_t org_n = box.org_dim.x * box.org_dim.y * box.org_dim.z;
+    if (roi->method_ == mqi::CONTOUR) {
+        ///< runs are split at rows, the only places where they stop being consecutive
+        std::vector<uint32_t> start, stride, acc_stride;
+        for (uint32_t c = 0; c < roi->length_; ++c) {
+            uint32_t s = roi->start_[c];
+            uint32_t n = roi->stride_[c];
+            while (n > 0) {
+                uint32_t piece = std::min<uint32_t>(n, box.dim.x - s % box.dim.x);
+                start.push_back(box.to_original(s));
+                stride.push_back(piece);
+                acc_stride.push_back((acc_stride.empty() ? 0 : acc_stride.back()) + piece);
+                s += piece;
+                n -= piece;
+            }
+        }
+        uint32_t* start_a      = new uint32_t[start.size()];
+        uint32_t* stride_a     = new uint32_t[stride.size()];
+        uint32_t* acc_stride_a = new uint32_t[acc_stride.size()];
+        std::copy(start.begin(), start.end(), start_a);
+        std::copy(stride.begin(), stride.end(), stride_a);
+        std::copy(acc_stride.begin(), acc_stride.end(), acc_stride_a);
+        return new roi_t(mqi::CONTOUR, org_n, start.size(), start_a, stride_a, acc_stride_a);
+    }
+    ///< INDIRECT and DIRECT become a lookup from original voxel to scorer index
+    uint32_t* lookup = new uint32_t[org_n];
+    std::fill(lookup, lookup + org_n, uint32_t(-1));
+    uint32_t n = (roi->method_ == mqi::INDIRECT) ? roi->original_length_ : dense_size;
+    for (uint32_t v = 0; v < n && v < box.n_voxels(); ++v) {
+        lookup[box.to_original(v)] = (roi->method_ == mqi::INDIRECT) ? roi->start_[v] : v;
+    }
+    return new roi_t(mqi::INDIRECT, org_n, dense_size, lookup);
+}
+
+///< Map the voxel keys and the ROI of a scorer of the box to the original grid.
+///< The hash table is only iterated afterwards, so its keys are rewritten in place.
+///< The variance tables are indexed by voxel, so clipping is not used with variance scoring.
+template<typename R>
+void
+unclip_scorer(mqi::scorer<R>* s, const clip_box_t& box) {
+    assert(s->count_ == nullptr && s->mean_ == nullptr && s->variance_ == nullptr);
+    if (s->data_ != nullptr) {
+        for (uint32_t ind = 0; ind < s->max_capacity_; ++ind) {
+            if (s->data_[ind].key1 != mqi::empty_pair && s->data_[ind].key2 != mqi::empty_pair)
+                s->data_[ind].key1 = box.to_original(s->data_[ind].key1);
+        }
+    }
+    if (s->dense_ != nullptr) {
+        ///< the ROI of the box and its arrays are only referenced by this scorer
+        roi_t* roi = s->roi_;
+        s->roi_    = unclip_roi(roi, s->dense_size_, box);
+        delete[] roi->start_;
+        delete[] roi->stride_;
+        delete[] roi->acc_stride_;
+        delete roi;
+    }
+}
+
+}   // namespace mqi
+
+#endif
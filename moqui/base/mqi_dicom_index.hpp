@@ -0,0 +1,268 @@
+#ifndef MQI_DICOM_INDEX_HPP
+#define MQI_DICOM_INDEX_HPP
+
+/// \file
+///
+/// Header index of a DICOM directory.
+/// Every file of the directory is read once, up to the last tag the loaders need, so pixel
+/// data, dose grids and the contour and beam sequences of RT objects are never parsed.
+/// The index holds the modality of every DICOM file and the geometry tags of the images and is
+/// kept in a binary cache in the directory, keyed by the name, size and modification time of
+/// every file, like the CT cache.
+/// The CT, RTPLAN and RTSTRUCT loaders take their file lists and metadata from the index.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gdcmAttribute.h"
+#include "gdcmReader.h"
+
+#include <moqui/base/mqi_mapped_file.hpp>
+#include <moqui/base/mqi_parallel.hpp>
+
+namespace mqi
+{
+
+///< Header tags of one DICOM file, as text without padding
+struct dicom_entry_t {
+    std::string file;                ///< path of the file
+    std::string modality;            ///< (0008,0060)
+    std::string sop_uid;             ///< (0008,0018) SOP instance UID
+    std::string series_uid;          ///< (0020,000e) series instance UID
+    std::string image_position;      ///< (0020,0032) x\y\z
+    std::string image_orientation;   ///< (0020,0037) row and column direction cosines
+    std::string pixel_spacing;       ///< (0028,0030) row spacing\column spacing
+    std::string slice_thickness;     ///< (0018,0050)
+    uint32_t    rows    = 0;         ///< (0028,0010)
+    uint32_t    columns = 0;         ///< (0028,0011)
+};
+
+///< DICOM files of a directory in name order
+struct dicom_index_t {
+    std::string                dir;
+    uint32_t                   n_files = 0;   ///< regular files in dir, DICOM or not
+    std::vector<dicom_entry_t> entries;
+
+    ///< Files of a modality in name order
+    std::vector<std::string>
+    files(const std::string& modality) const {
+        std::vector<std::string> list;
+        for (const dicom_entry_t& entry : entries) {
+            if (entry.modality == modality) list.push_back(entry.file);
+        }
+        return list;
+    }
+
+    ///< Entries of a modality in name order
+    std::vector<const dicom_entry_t*>
+    find(const std::string& modality) const {
+        std::vector<const dicom_entry_t*> list;
+        for (const dicom_entry_t& entry : entries) {
+            if (entry.modality == modality) list.push_back(&entry);
+        }
+        return list;
+    }
+};
+
+const char     dicom_index_name[]  = ".moqui_dicom_index";
+const char     dicom_index_magic[] = "MQIDIX1";   ///< 8 bytes with the terminating zero
+const uint32_t dicom_index_version = 2;
+
+///< Read the index tags of file into entry.
+///< Returns false if the file is not DICOM.
+inline bool
+read_dicom_header(const std::string& file, dicom_entry_t& entry) {
+    ///< the reader stops after the largest of these tags
+    static const std::set<gdcm::Tag> tags = {
+        gdcm::Tag(0x0008, 0x0018), gdcm::Tag(0x0008, 0x0060), gdcm::Tag(0x0018, 0x0050),
+        gdcm::Tag(0x0020, 0x000e), gdcm::Tag(0x0020, 0x0032), gdcm::Tag(0x0020, 0x0037),
+        gdcm::Tag(0x0028, 0x0010), gdcm::Tag(0x0028, 0x0011), gdcm::Tag(0x0028, 0x0030)
+    };
+    gdcm::Reader reader;
+    reader.SetFileName(file.c_str());
+    if (!reader.ReadSelectedTags(tags)) return false;
+    const gdcm::DataSet& ds = reader.GetFile().GetDataSet();
+
+    auto value = [&](uint16_t group, uint16_t element) {
+        const gdcm::Tag tag(group, element);
+        if (!ds.FindDataElement(tag)) return std::string();
+        const gdcm::ByteValue* bv = ds.GetDataElement(tag).GetByteValue();
+        if (bv == nullptr) return std::string();
+        std::string str(bv->GetPointer(), uint32_t(bv->GetLength()));
+        str.erase(str.find_last_not_of(std::string(" \0", 2)) + 1);
+        return str;
+    };
+    entry.file              = file;
+    entry.modality          = value(0x0008, 0x0060);
+    entry.sop_uid           = value(0x0008, 0x0018);
+    entry.series_uid        = value(0x0020, 0x000e);
+    entry.image_position    = value(0x0020, 0x0032);
+    entry.image_orientation = value(0x0020, 0x0037);
+    entry.pixel_spacing     = value(0x0028, 0x0030);
+    entry.slice_thickness   = value(0x0018, 0x0050);
+    if (ds.FindDataElement(gdcm::Tag(0x0028, 0x0010))) {
+        gdcm::Attribute<0x0028, 0x0010> at;
+        at.SetFromDataElement(ds.GetDataElement(gdcm::Tag(0x0028, 0x0010)));
+        entry.rows = at.GetValue();
+    }
+    if (ds.FindDataElement(gdcm::Tag(0x0028, 0x0011))) {
+        gdcm::Attribute<0x0028, 0x0011> at;
+        at.SetFromDataElement(ds.GetDataElement(gdcm::Tag(0x0028, 0x0011)));
+        entry.columns = at.GetValue();
+    }
+    return true;
+}
+
+///< Load the cache of dir into index.
+///< Returns false if there is no cache, it was written for other files or it has another format
+///< version.
+inline bool
+read_dicom_index(const std::filesystem::path&   cache,
+                 const std::string&             dir,
+                 const std::vector<file_key_t>& files,
+                 dicom_index_t&                 index) {
+    if (!std::filesystem::exists(cache)) return false;
+    mqi::mapped_file map(cache.string());
+    const char*      p    = map.begin();
+    auto             take = [&](void* dst, size_t n) {
+        if (size_t(map.end() - p) < n) return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+    auto take_string = [&](std::string& str) {
+        uint32_t len;
+        if (!take(&len, 4) || size_t(map.end() - p) < len) return false;
+        str.assign(p, len);
+        p += len;
+        return true;
+    };
+    char     magic[sizeof(dicom_index_magic)];
+    uint32_t version, n_files, n_entries;
+    if (!take(magic, sizeof(magic)) || std::memcmp(magic, dicom_index_magic, sizeof(magic)) != 0 ||
+        !take(&version, 4) || version != dicom_index_version || !take(&n_files, 4) ||
+        n_files != files.size())
+        return false;
+    for (const file_key_t& key : files) {
+        std::string name;
+        uint64_t    size;
+        int64_t     mtime;
+        if (!take_string(name) || name != key.name || !take(&size, 8) || size != key.size ||
+            !take(&mtime, 8) || mtime != key.mtime)
+            return false;
+    }
+    if (!take(&n_entries, 4)) return false;
+    index.n_files = n_files;
+    index.dir = dir;
+    index.entries.resize(n_entries);
+    for (dicom_entry_t& entry : index.entries) {
+        std::string name;
+        if (!take_string(name) || !take_string(entry.modality) || !take_string(entry.sop_uid) ||
+            !take_string(entry.series_uid) || !take_string(entry.image_position) ||
+            !take_string(entry.image_orientation) || !take_string(entry.pixel_spacing) ||
+            !take_string(entry.slice_thickness) || !take(&entry.rows, 4) ||
+            !take(&entry.columns, 4))
+            return false;
+        entry.file = (std::filesystem::path(dir) / name).string();
+    }
+    return p == map.end();
+}
+
+///< Write the cache of index for files, replacing an old one atomically.
+///< A cache that can not be written, e.g. in a read-only DICOM directory, is skipped.
+inline void
+write_dicom_index(const std::filesystem::path&   cache,
+                  const std::vector<file_key_t>& files,
+                  const dicom_index_t&           index) {
+    std::filesystem::path tmp = cache;
+    tmp += ".tmp";
+    {
+        std::ofstream fs(tmp, std::ios::binary | std::ios::trunc);
+        if (!fs) {
+            printf("Writing DICOM index.. : Can not write %s, skipped\n", tmp.string().c_str());
+            return;
+        }
+        auto put = [&](const void* src, size_t n) {
+            fs.write(reinterpret_cast<const char*>(src), n);
+        };
+        auto put_string = [&](const std::string& str) {
+            uint32_t len = str.size();
+            put(&len, 4);
+            put(str.data(), len);
+        };
+        uint32_t n_files   = files.size();
+        uint32_t n_entries = index.entries.size();
+        put(dicom_index_magic, sizeof(dicom_index_magic));
+        put(&dicom_index_version, 4);
+        put(&n_files, 4);
+        for (const file_key_t& key : files) {
+            put_string(key.name);
+            put(&key.size, 8);
+            put(&key.mtime, 8);
+        }
+        put(&n_entries, 4);
+        for (const dicom_entry_t& entry : index.entries) {
+            put_string(std::filesystem::path(entry.file).filename().string());
+            put_string(entry.modality);
+            put_string(entry.sop_uid);
+            put_string(entry.series_uid);
+            put_string(entry.image_position);
+            put_string(entry.image_orientation);
+            put_string(entry.pixel_spacing);
+            put_string(entry.slice_thickness);
+            put(&entry.rows, 4);
+            put(&entry.columns, 4);
+        }
+        if (!fs) {
+            printf("Writing DICOM index.. : Failed to write %s, skipped\n", tmp.string().c_str());
+            fs.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, cache, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+///< Index the DICOM files of dir (not recursive), from the cache in dir when none of the files
+///< changed since it was written. Otherwise the headers are read concurrently by n_workers and the
+///< cache is rewritten. Cache files of moqui are skipped.
+inline dicom_index_t
+index_dicom_dir(const std::string& dir, uint32_t n_workers, bool use_cache = true) {
+    dicom_index_t                 index;
+    std::filesystem::path         cache = std::filesystem::path(dir) / dicom_index_name;
+    const std::vector<file_key_t> keys  = mqi::dir_file_keys(dir);
+    if (use_cache && read_dicom_index(cache, dir, keys, index)) {
+        printf("Reading DICOM directory.. : Loaded index from cache %s\n", cache.string().c_str());
+        return index;
+    }
+    std::vector<std::filesystem::path> files;
+    for (const file_key_t& key : keys) {
+        files.push_back(std::filesystem::path(dir) / key.name);
+    }
+
+    std::vector<dicom_entry_t> entries(files.size());
+    std::vector<char>          is_dicom(files.size(), 0);
+    mqi::parallel_for(files.size(), n_workers, [&](size_t i) {
+        is_dicom[i] = read_dicom_header(files[i].string(), entries[i]);
+    });
+    index.dir     = dir;
+    index.n_files = files.size();
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (is_dicom[i]) index.entries.push_back(std::move(entries[i]));
+    }
+    if (use_cache) write_dicom_index(cache, keys, index);
+    return index;
+}
+
+}   // namespace mqi
+
+#endif
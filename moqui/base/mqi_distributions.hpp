@@ -11,6 +11,7 @@
 #include <moqui/base/distributions/mqi_pdfMd.hpp>
 #include <moqui/base/distributions/mqi_phsp6d.hpp>
 #include <moqui/base/distributions/mqi_phsp6d_fanbeam.hpp>
+#include <moqui/base/distributions/mqi_phsp6d_ray.hpp>
 #include <moqui/base/distributions/mqi_phsp6d_uniform.hpp>
 #include <moqui/base/distributions/mqi_uni_1d.hpp>
 
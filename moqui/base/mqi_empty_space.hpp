@@ -0,0 +1,86 @@
+#ifndef MQI_EMPTY_SPACE_HPP
+#define MQI_EMPTY_SPACE_HPP
+
+/// \file
+///
+/// Distance map of empty space (air around the patient) for a density grid.
+/// The transport uses it to cross air in one step instead of voxel by voxel.
+
+#include <algorithm>
+#include <cstdint>
+
+#include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_vec.hpp>
+
+namespace mqi
+{
+
+///< Chessboard distance, in voxels, from each voxel to the nearest voxel that is not empty.
+///< Empty voxels have a density (g/mm^3) below threshold and, when a body mask is given,
+///< lie outside the body; a non-empty voxel has 0. Distances are capped at max_dist.
+///< A map value d guarantees that every voxel within d - 1 cells of the voxel is empty.
+///< Two raster passes over the 26-neighbourhood give the exact chessboard distance.
+inline uint8_t*
+build_empty_space_map(const mqi::density_t*        density,
+                      const mqi::vec3<mqi::ijk_t>& dim,
+                      float                        threshold,
+                      const uint8_t*               body     = nullptr,
+                      uint8_t                      max_dist = 255) {
+    const int64_t nx = dim.x, ny = dim.y, nz = dim.z;
+    const int64_t nxy = nx * ny;
+    uint8_t*      map = new uint8_t[nxy * nz];
+    for (int64_t i = 0; i < nxy * nz; ++i) {
+        bool empty = density[i] < threshold && (body == nullptr || body[i] == 0);
+        map[i]     = empty ? max_dist : 0;
+    }
+
+    ///< forward pass looks at the 13 neighbours already visited, backward at the other 13
+    for (int pass = 0; pass < 2; ++pass) {
+        const int s = (pass == 0) ? -1 : 1;
+        for (int64_t k0 = 0; k0 < nz; ++k0) {
+            int64_t k = (pass == 0) ? k0 : nz - 1 - k0;
+            for (int64_t j0 = 0; j0 < ny; ++j0) {
+                int64_t j = (pass == 0) ? j0 : ny - 1 - j0;
+                for (int64_t i0 = 0; i0 < nx; ++i0) {
+                    int64_t  i = (pass == 0) ? i0 : nx - 1 - i0;
+                    uint8_t& d = map[k * nxy + j * nx + i];
+                    if (d == 0) continue;
+                    for (int dk = -1; dk <= 1; ++dk) {
+                        for (int dj = -1; dj <= 1; ++dj) {
+                            for (int di = -1; di <= 1; ++di) {
+                                ///< neighbour precedes the voxel in the pass order
+                                int order = (dk != 0) ? dk : (dj != 0) ? dj : di;
+                                if (order != s) continue;
+                                int64_t kk = k + dk, jj = j + dj, ii = i + di;
+                                if (kk < 0 || kk >= nz || jj < 0 || jj >= ny || ii < 0 ||
+                                    ii >= nx)
+                                    continue;
+                                uint8_t n = map[kk * nxy + jj * nx + ii];
+                                if (n + 1 < d) d = n + 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return map;
+}
+
+///< Smallest voxel spacing of a rectilinear grid, the length of one map unit
+template<typename R>
+R
+empty_space_step(const R* xe, const R* ye, const R* ze, const mqi::vec3<mqi::ijk_t>& dim) {
+    R h = xe[1] - xe[0];
+    for (mqi::ijk_t i = 0; i < dim.x; ++i)
+        h = std::min(h, xe[i + 1] - xe[i]);
+    for (mqi::ijk_t i = 0; i < dim.y; ++i)
+        h = std::min(h, ye[i + 1] - ye[i]);
+    for (mqi::ijk_t i = 0; i < dim.z; ++i)
+        h = std::min(h, ze[i + 1] - ze[i]);
+    return h;
+}
+
+}   // namespace mqi
+
+#endif
@@ -199,6 +199,12 @@ public:
                 }
             }
         }
+        if (ind_started) {
+            ///< close a stride running up to the last voxel
+            acc_stride_tmp = (acc_stride_vec.size() > 0) ? acc_stride_vec.back() : 0;
+            stride_vec.push_back(this->ct_size - start_vec.back());
+            acc_stride_vec.push_back(acc_stride_tmp + stride_vec.back());
+        }
         uint32_t* start      = new uint32_t[start_vec.size()];
         uint32_t* stride     = new uint32_t[start_vec.size()];
         uint32_t* acc_stride = new uint32_t[acc_stride_vec.size()];
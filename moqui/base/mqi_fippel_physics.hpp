@@ -139,8 +139,6 @@ public:
         } else if ((mfp < distance_to_boundary ||
                     mqi::mqi_abs(mfp - distance_to_boundary) < mqi::geometry_tolerance) &&
                    (mfp < step_limit || mqi::mqi_abs(mfp - step_limit) < mqi::geometry_tolerance)) {
-            int p = 0;
-
 #ifdef DEBUG
             printf("\tmfp: %.3f, ke: %.3f, primary:%d\n", mfp, trk.vtx0.ke, trk.primary);
             if (mfp < 0) { printf("mfp: %.3f, ke: %.3f\n", mfp, trk.vtx0.ke); }
@@ -150,30 +148,7 @@ public:
             p_ion.along_step(trk, stk, rng, mfp, mat);
             assert_track<R>(trk, 10);
             if (trk.vtx1.ke < this->Tp_cut) { return; }
-            R u          = cs_sum * mqi_uniform<R>(rng);   //0-1
-            trk.vtx1.dir = trk.vtx0.dir;
-            if (u < cs[0]) {
-                p = 0;
-                p_ion.post_step(trk, stk, rng, mfp, mat, score_local_deposit);
-                assert_track<R>(trk, 1);
-            } else if (u < (cs[0] + cs[1])) {
-                p = 1;
-                pp_e.post_step(trk, stk, rng, mfp, mat, score_local_deposit);
-                assert_track<R>(trk, 2);
-            } else if (u < (cs[0] + cs[1] + cs[2])) {
-                p = 2;
-                po_e.post_step(trk, stk, rng, mfp, mat, score_local_deposit);
-                assert_track<R>(trk, 3);
-            } else if (u < (cs[0] + cs[1] + cs[2] + cs[3])) {
-                p = 3;
-                po_i.post_step(trk, stk, rng, mfp, mat, score_local_deposit);
-                assert_track<R>(trk, 4);
-            } else {   //u
-            }
-
-#ifdef DEBUG
-            if (p != 0) printf("Process: %d\n", p);
-#endif
+            this->interact(trk, stk, rng, cs, cs_sum, mfp, mat, score_local_deposit);
         } else {
 
 #ifdef DEBUG
@@ -192,6 +167,83 @@ public:
         //don't trk.move() here
         return;
     }
+
+    ///< discrete interaction at the end of a step, selected by the cross-sections cs
+    CUDA_HOST_DEVICE
+    void
+    interact(track_t<R>&       trk,
+             track_stack_t<R>& stk,
+             mqi_rng*          rng,
+             const R*          cs,
+             const R&          cs_sum,
+             const R&          len,
+             material_t<R>&    mat,
+             bool              score_local_deposit) {
+        int p        = 0;
+        R   u        = cs_sum * mqi_uniform<R>(rng);   //0-1
+        trk.vtx1.dir = trk.vtx0.dir;
+        if (u < cs[0]) {
+            p = 0;
+            p_ion.post_step(trk, stk, rng, len, mat, score_local_deposit);
+            assert_track<R>(trk, 1);
+        } else if (u < (cs[0] + cs[1])) {
+            p = 1;
+            pp_e.post_step(trk, stk, rng, len, mat, score_local_deposit);
+            assert_track<R>(trk, 2);
+        } else if (u < (cs[0] + cs[1] + cs[2])) {
+            p = 2;
+            po_e.post_step(trk, stk, rng, len, mat, score_local_deposit);
+            assert_track<R>(trk, 3);
+        } else if (u < (cs[0] + cs[1] + cs[2] + cs[3])) {
+            p = 3;
+            po_i.post_step(trk, stk, rng, len, mat, score_local_deposit);
+            assert_track<R>(trk, 4);
+        } else {   //u
+        }
+
+#ifdef DEBUG
+        if (p != 0) printf("Process: %d\n", p);
+#endif
+    }
+
+    ///< step length for delta (Woodcock) tracking
+    ///< mat holds the majorant density of the node. Cross-sections scale with density
+    ///< and the step limits shrink with it, so the step is valid in every voxel it crosses.
+    ///< cs and cs_sum are filled for interact(); collision tells whether the step ends
+    ///< at a candidate interaction, to be accepted with rho_local / rho_majorant.
+    CUDA_HOST_DEVICE
+    R
+    woodcock_step(track_t<R>& trk, mqi_rng* rng, material_t<R>& mat, R* cs, R& cs_sum, bool& collision) {
+        mqi::relativistic_quantities<R> rel(trk.vtx0.ke, units.Mp);
+        R max_loss_step    = max_energy_loss * -1.0 * rel.Ek / p_ion.dEdx(rel, mat);
+        R current_min_step = this->max_step * mat.stopping_power_ratio(rel.Ek) * mat.rho_mass /
+                             this->units.water_density;
+        current_min_step  = (current_min_step <= max_loss_step) ? current_min_step : max_loss_step;
+        R max_loss_energy = -1.0 * current_min_step * p_ion.dEdx(rel, mat);
+
+        R cs1[4] = { p_ion.cross_section(rel, mat),
+                     pp_e.cross_section(rel, mat),
+                     po_e.cross_section(rel, mat),
+                     po_i.cross_section(rel, mat) };
+        mqi::relativistic_quantities<R> rel_de(trk.vtx0.ke - max_loss_energy, units.Mp);
+        R cs2[4] = { p_ion.cross_section(rel_de, mat),
+                     pp_e.cross_section(rel_de, mat),
+                     po_e.cross_section(rel_de, mat),
+                     po_i.cross_section(rel_de, mat) };
+        R cs1_sum = cs1[0] + cs1[1] + cs1[2] + cs1[3];
+        R cs2_sum = cs2[0] + cs2[1] + cs2[2] + cs2[3];
+        R* pick   = (cs1_sum >= cs2_sum) ? cs1 : cs2;
+        cs_sum    = (cs1_sum >= cs2_sum) ? cs1_sum : cs2_sum;
+        for (int i = 0; i < 4; ++i) {
+            cs[i] = pick[i];
+        }
+
+        R mfp        = -1.0f * logf(mqi_uniform<R>(rng)) / cs_sum;
+        R step_limit = current_min_step * this->units.water_density /
+                       (mat.stopping_power_ratio(rel.Ek) * mat.rho_mass);
+        collision    = (mfp < step_limit);
+        return collision ? mfp : step_limit;
+    }
 };
 
 }   // namespace mqi
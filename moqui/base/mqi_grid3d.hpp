@@ -59,6 +59,52 @@ protected:
     ///< size: dim_.x*dim_.y*dim_.z
     T* data_ = nullptr;
 
+    ///< Equally spaced edges on all axes (typical CT), detected from the edges.
+    ///< Uniform grids locate and leave voxels with arithmetic instead of edge searches.
+    bool         uniform_ = false;
+    mqi::vec3<R> spacing_;       ///< voxel size when uniform_
+    mqi::vec3<R> inv_spacing_;   ///< 1 / spacing_
+
+    ///< true if edges e[0..n] are equally spaced within a tenth of the geometry tolerance
+    CUDA_HOST_DEVICE
+    static bool
+    is_uniform(const R* e, ijk_t n) {
+        R h = (e[n] - e[0]) / n;
+        for (ijk_t i = 1; i < n; ++i) {
+            if (mqi::mqi_abs(e[i] - (e[0] + i * h)) > 0.1 * mqi::geometry_tolerance) return false;
+        }
+        return true;
+    }
+
+    ///< index along one axis of a uniform grid, same boundary rules as index(p, dir)
+    CUDA_HOST_DEVICE
+    inline ijk_t
+    uniform_index(R p, R dir, R e0, R h, R inv_h, ijk_t n) const {
+        R     f    = (p - e0) * inv_h;
+        ijk_t edge = static_cast<ijk_t>(mqi::mqi_floor(f + 0.5));
+        if (edge >= 0 && edge <= n && mqi::mqi_abs(p - (e0 + edge * h)) < mqi::geometry_tolerance) {
+            if (edge == 0) return (dir < 0) ? -1 : 0;
+            return (dir > 0) ? edge : edge - 1;
+        }
+        if (f <= 0 || f >= n) return -1;
+        return static_cast<ijk_t>(f);
+    }
+
+    ///< distance to leave [lo, hi] along one axis, same tolerance rules as intersect(p, d, idx)
+    CUDA_HOST_DEVICE
+    static inline R
+    axis_exit(R p, R& d, R lo, R hi, bool has_lower, bool has_upper) {
+        if (d * d <= mqi::near_zero) {
+            d = 0;
+            return mqi::p_inf;
+        }
+        R t = (d < 0) ? -(p - lo) / d : (hi - p) / d;
+        if (mqi::mqi_abs(t) < mqi::geometry_tolerance && ((d < 0) ? has_lower : has_upper)) {
+            return 1 / mqi::geometry_tolerance;
+        }
+        return t;
+    }
+
     ///< Calculate C000/C111
     CUDA_HOST_DEVICE
     void
@@ -86,6 +132,16 @@ protected:
         n100_.normalize();
         n010_.normalize();
         n001_.normalize();
+
+        uniform_ = is_uniform(xe_, dim_.x) && is_uniform(ye_, dim_.y) && is_uniform(ze_, dim_.z);
+        if (uniform_) {
+            spacing_.x     = (V111_.x - V000_.x) / dim_.x;
+            spacing_.y     = (V111_.y - V000_.y) / dim_.y;
+            spacing_.z     = (V111_.z - V000_.z) / dim_.z;
+            inv_spacing_.x = 1.0 / spacing_.x;
+            inv_spacing_.y = 1.0 / spacing_.y;
+            inv_spacing_.z = 1.0 / spacing_.z;
+        }
     }
 
 public:
@@ -318,7 +374,7 @@ public:
 
     ///< Destructor releases dynamic allocation for x/y/z coordinates
     CUDA_HOST_DEVICE
-    ~grid3d() {}
+    virtual ~grid3d() {}
 
     /// set edge pointer
     /// \return pointer of data
@@ -485,11 +541,44 @@ public:
         volume *= ze_[vox.z + 1] - ze_[vox.z];
         return volume;
     }
+    /// Returns true if the edges are equally spaced on all axes
+    CUDA_HOST_DEVICE
+    bool
+    is_uniform() const {
+        return uniform_;
+    }
+
+    ///< intersect for uniform grids: voxel bounds from the index, no edge reads
+    CUDA_HOST_DEVICE
+    intersect_t<R>
+    intersect_uniform(mqi::vec3<R>& p, mqi::vec3<R>& d, mqi::vec3<ijk_t>& idx) {
+        mqi::intersect_t<R> its;
+        its.cell = idx;
+        its.side = mqi::NONE_XYZ_PLANE;
+        R lo_x   = V000_.x + idx.x * spacing_.x;
+        R lo_y   = V000_.y + idx.y * spacing_.y;
+        R lo_z   = V000_.z + idx.z * spacing_.z;
+        R t_x    = axis_exit(p.x, d.x, lo_x, lo_x + spacing_.x, idx.x > 0, idx.x < dim_.x);
+        R t_y    = axis_exit(p.y, d.y, lo_y, lo_y + spacing_.y, idx.y > 0, idx.y < dim_.y);
+        R t_z    = axis_exit(p.z, d.z, lo_z, lo_z + spacing_.z, idx.z > 0, idx.z < dim_.z);
+        R u_max  = (t_x < t_y) ? ((t_x < t_z) ? t_x : t_z) : ((t_y < t_z) ? t_y : t_z);
+        if (u_max > 0) {
+            its.dist = u_max;
+        } else {
+            its.dist   = -1.0;
+            its.cell.x = -1;
+            its.cell.y = -1;
+            its.cell.z = -1;
+        }
+        return its;
+    }
+
     ///< intersect. a ray from a voxel (ijk) in the grid
     /// written by Hoyeon, plane equation based
     CUDA_HOST_DEVICE
     intersect_t<R>
     intersect(mqi::vec3<R>& p, mqi::vec3<R>& d, mqi::vec3<ijk_t>& idx) {
+        if (uniform_) return intersect_uniform(p, d, idx);
         /// n100_ is vector of x-axis
         /// Change the method to operate with roated box
         mqi::intersect_t<R> its;   //return value
@@ -747,6 +836,12 @@ public:
     index(const mqi::vec3<R>& p, mqi::vec3<R>& dir)   // if p is on boundary
     {   //find index for the first intersection, return voxel index
         mqi::vec3<ijk_t> idx;
+        if (uniform_) {
+            idx.x = uniform_index(p.x, dir.x, V000_.x, spacing_.x, inv_spacing_.x, dim_.x);
+            idx.y = uniform_index(p.y, dir.y, V000_.y, spacing_.y, inv_spacing_.y, dim_.y);
+            idx.z = uniform_index(p.z, dir.z, V000_.z, spacing_.z, inv_spacing_.z, dim_.z);
+            return idx;
+        }
         R                min_x = 100.0, min_y = 100.0, min_z = 100.0;
         for (int ind = 0; ind < dim_.x; ind++) {
             if (mqi::mqi_abs(xe_[ind] - p.x) < mqi::geometry_tolerance) {
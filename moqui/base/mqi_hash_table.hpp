@@ -1,9 +1,14 @@
 #ifndef MQI_HASH_TABLE_CLASS_HPP
 #define MQI_HASH_TABLE_CLASS_HPP
 
+#include <cstddef>
 #include <cstring>
 #include <moqui/base/mqi_common.hpp>
 
+#if !defined(__CUDACC__)
+#include <stdexcept>
+#endif
+
 namespace mqi
 {
 
@@ -13,6 +18,96 @@ struct key_value {
     double     value;
 };
 
+#if !defined(__CUDACC__)
+///< Host-side lock-free access to key_value tables.
+///< key1 and key2 share one 8-byte aligned word, so a (voxel, spot) pair is claimed
+///< with a single 64-bit compare-and-swap and is never observed half-written.
+///< The atomics work directly on the key_value storage, so the table layout
+///< stays identical to the one uploaded to and downloaded from the GPU.
+static_assert(offsetof(key_value, key2) == sizeof(key_t), "key1 and key2 must be adjacent");
+static_assert(alignof(key_value) >= sizeof(uint64_t), "key pair must be 64-bit aligned");
+
+///< Packs two keys into the word they occupy in key_value
+inline uint64_t
+pack_keys(key_t key1, key_t key2) {
+    key_t    pair[2] = { key1, key2 };
+    uint64_t packed;
+    std::memcpy(&packed, pair, sizeof(packed));
+    return packed;
+}
+
+///< Atomic add for float and double without a lock
+template<typename T>
+inline void
+atomic_add(T* address, T val) {
+    T old;
+    __atomic_load(address, &old, __ATOMIC_RELAXED);
+    T desired = old + val;
+    while (!__atomic_compare_exchange(
+      address, &old, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        desired = old + val;
+    }
+}
+
+///< Adds value to the entry of (key1, key2), claiming an empty slot if needed.
+///< slot is the initial probe position, wrapped into the table of max_capacity entries.
+inline void
+insert_key_value(key_value* table,
+                 uint32_t   slot,
+                 key_t      key1,
+                 key_t      key2,
+                 double     value,
+                 uint32_t   max_capacity) {
+    const uint64_t empty  = pack_keys(mqi::empty_pair, mqi::empty_pair);
+    const uint64_t packed = pack_keys(key1, key2);
+    slot %= max_capacity;
+    for (uint32_t probe = 0; probe < max_capacity; ++probe) {
+        uint64_t* word = reinterpret_cast<uint64_t*>(&table[slot].key1);
+        uint64_t  prev = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (prev == empty &&
+            __atomic_compare_exchange_n(
+              word, &prev, packed, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            prev = packed;
+        }
+        if (prev == packed) {
+            atomic_add(&table[slot].value, value);
+            return;
+        }
+        if (++slot == max_capacity) slot = 0;
+    }
+    throw std::runtime_error("Scorer hash table is full.");
+}
+
+///< Striped spin locks for host updates that read and write several tables of one voxel.
+///< Voxels share a lock when their index is equal modulo voxel_lock_stripes.
+const uint32_t voxel_lock_stripes = 4096;
+
+inline uint32_t*
+voxel_locks() {
+    static uint32_t locks[voxel_lock_stripes] = {};
+    return locks;
+}
+
+///< Holds the lock of a voxel for the lifetime of the guard
+struct voxel_lock_guard {
+    uint32_t* lock;
+
+    voxel_lock_guard(uint32_t voxel) : lock(voxel_locks() + voxel % voxel_lock_stripes) {
+        while (__atomic_exchange_n(lock, 1u, __ATOMIC_ACQUIRE)) {
+            while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {}
+        }
+    }
+
+    ~voxel_lock_guard() {
+        __atomic_store_n(lock, 0u, __ATOMIC_RELEASE);
+    }
+
+    voxel_lock_guard(const voxel_lock_guard&) = delete;
+    voxel_lock_guard&
+    operator=(const voxel_lock_guard&) = delete;
+};
+#endif
+
 void
 init_table(key_value* table, uint32_t max_capacity) {
     //// Multithreading?
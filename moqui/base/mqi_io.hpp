@@ -137,6 +137,18 @@ mqi::io::save_to_bin(const mqi::scorer<R>* src,
     key1.clear();
     key2.clear();
     value.clear();
+    if (src->dense_) {
+        ///< dense scorers are written by transport voxel with key2 = 0
+        std::vector<double> volume(src->roi_->original_length_, 0.0);
+        src->dense_to_volume(volume.data(), volume.size());
+        for (uint32_t v = 0; v < volume.size(); v++) {
+            if (volume[v] > 0) {
+                key1.push_back(v);
+                key2.push_back(0);
+                value.push_back(volume[v] * scale);
+            }
+        }
+    }
     for (int ind = 0; ind < src->max_capacity_; ind++) {
         if (src->data_[ind].key1 != mqi::empty_pair && src->data_[ind].key2 != mqi::empty_pair &&
             src->data_[ind].value > 0) {
@@ -640,6 +652,14 @@ mqi::io::save_to_dcm(const mqi::scorer<R>* src,
     size_t actual_size = static_cast<size_t>(dim.x) * dim.y * dim.z;
     dose_data.resize(actual_size, 0.0);
 
+    // Dense scorers hold one value per ROI voxel
+    if (src->dense_) {
+        src->dense_to_volume(dose_data.data(), actual_size);
+        for (size_t i = 0; i < actual_size; i++) {
+            dose_data[i] *= scale;
+        }
+    }
+
     // Extract and accumulate dose values from hash table
     for (int ind = 0; ind < src->max_capacity_; ind++) {
         if (src->data_[ind].key1 != mqi::empty_pair &&
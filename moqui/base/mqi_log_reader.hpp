@@ -0,0 +1,310 @@
+#ifndef MQI_LOG_READER_HPP
+#define MQI_LOG_READER_HPP
+
+/// \file
+///
+/// Reader of delivery log files (SMC/SHI layer CSVs).
+/// A layer file <layer>_<energy>MeV.csv holds comma separated samples of
+/// time (ms), x (mm), y (mm) and MU count. Files are memory mapped and the numbers
+/// are parsed field by field with strtof/strtod, which every supported compiler provides
+/// (floating point std::from_chars needs GCC 11).
+/// The parsed layers of a field are kept in a binary cache next to the CSVs, keyed by
+/// the name, size and modification time of every layer file, so repeated runs of the
+/// same fraction map the cache instead of parsing text.
+/// index_log_dir lists the field folders and layer files of a log directory once for all beams.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <moqui/base/mqi_beam_module_ion.hpp>
+#include <moqui/base/mqi_mapped_file.hpp>
+#include <moqui/base/mqi_parallel.hpp>
+
+namespace mqi
+{
+
+///< Energy (MeV) of a layer file from its name, <layer>_<energy>MeV.csv
+inline float
+log_layer_energy(const std::string& filename) {
+    size_t slash = filename.find_last_of("/\\");
+    size_t start = filename.find('_', (slash == std::string::npos) ? 0 : slash + 1);
+    if (start == std::string::npos)
+        throw std::runtime_error("No beam energy in log file name " + filename);
+    const char* first = filename.c_str() + start + 1;
+    char*       last  = nullptr;
+    float       e     = std::strtof(first, &last);
+    if (last == first) throw std::runtime_error("No beam energy in log file name " + filename);
+    return e;
+}
+
+///< Read the samples of one layer file.
+///< Fields are separated by commas or line breaks, with optional blanks around them.
+///< MU counts are truncated to integers and kept in mu; muCount has them scaled by
+///< particles_per_history and truncated per sample.
+///< An empty field, a field that is not a number or an incomplete last sample throws
+///< std::runtime_error instead of shifting the following columns.
+inline logfile_t
+read_logfile(const std::string& filename, float particles_per_history) {
+    mqi::mapped_file file(filename);
+    const char*      p = file.begin();
+    const char*      e = file.end();
+
+    ///< four fields per sample
+    size_t    n_samples = (std::count(p, e, ',') + 1) / 4 + 1;
+    logfile_t log;
+    log.time.reserve(n_samples);
+    log.posX.reserve(n_samples);
+    log.posY.reserve(n_samples);
+    log.muCount.reserve(n_samples);
+    log.mu.reserve(n_samples);
+
+    auto is_blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    ///< a trailing separator and line break at the end of the file are accepted
+    while (e > p && (is_blank(e[-1]) || e[-1] == '\n'))
+        --e;
+    if (e > p && e[-1] == ',') --e;
+    auto malformed = [&](const char* at) {
+        size_t line = std::count(file.begin(), at, '\n') + 1;
+        return std::runtime_error("Malformed log file " + filename + " at line " + std::to_string(line));
+    };
+
+    ///< a field is copied out of the mapping, which is not null terminated
+    char buf[64];
+    int  field = 0;
+    while (p < e) {
+        while (p < e && is_blank(*p))
+            ++p;
+        const char* first = p;
+        while (p < e && *p != ',' && *p != '\n' && !is_blank(*p))
+            ++p;
+        size_t len = p - first;
+        if (len == 0 || len >= sizeof(buf)) throw malformed(first);
+        std::memcpy(buf, first, len);
+        buf[len] = '\0';
+        char* last = nullptr;
+        ///< positions and times are read as float like std::stof, MU as a number truncated like std::stoi
+        float  f  = 0;
+        double mu = 0;
+        if (field < 3) {
+            f = std::strtof(buf, &last);
+        } else {
+            mu = std::strtod(buf, &last);
+        }
+        if (last != buf + len) throw malformed(first);
+
+        switch (field++) {
+        case 0:
+            log.time.push_back(f);
+            break;
+        case 1:
+            log.posX.push_back(f);
+            break;
+        case 2:
+            log.posY.push_back(f);
+            break;
+        default:
+            log.mu.push_back(static_cast<int>(mu));
+            log.muCount.push_back(static_cast<int>(mu) * particles_per_history);
+            field = 0;
+            break;
+        }
+
+        ///< exactly one separator, then another field
+        while (p < e && is_blank(*p))
+            ++p;
+        if (p == e) break;
+        if (*p != ',' && *p != '\n') throw malformed(p);
+        if (++p == e) throw malformed(p);
+    }
+    if (field != 0) throw malformed(e);
+    return log;
+}
+
+///< Layer files of one field folder in name order
+struct log_field_files_t {
+    std::filesystem::path              dir;
+    std::vector<std::filesystem::path> files;
+};
+
+///< Index the field folders of a log directory in name order, the position in the index is
+///< the beam index. Entries that are not folders are kept, without layer files, so they
+///< count like before. File names are only parsed when a field is read (read_log_field), so
+///< an odd file in the folder of a beam that is not simulated does not stop the run.
+inline std::vector<log_field_files_t>
+index_log_dir(const std::string& dir) {
+    std::vector<log_field_files_t> index;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dir)) {
+        index.emplace_back();
+        index.back().dir = entry.path();
+    }
+    std::sort(index.begin(), index.end(), [](const log_field_files_t& a, const log_field_files_t& b) {
+        return a.dir < b.dir;
+    });
+    for (log_field_files_t& field : index) {
+        if (!std::filesystem::is_directory(field.dir)) continue;
+        for (const std::filesystem::directory_entry& entry :
+             std::filesystem::directory_iterator(field.dir)) {
+            if (entry.path().extension() == ".csv") field.files.push_back(entry.path());
+        }
+        std::sort(field.files.begin(), field.files.end());
+    }
+    return index;
+}
+
+///< Layers of one field in file name order
+struct log_field_t {
+    std::vector<float>     energy;
+    std::vector<logfile_t> layers;
+};
+
+const char     log_cache_name[]  = ".moqui_log_cache";
+const char     log_cache_magic[] = "MQILOG";   ///< 7 bytes with the terminating zero
+const uint32_t log_cache_version = 2;
+
+///< Load the cache of files into field.
+///< Returns false if there is no cache or it was written for other files, another
+///< particles_per_history or another format version.
+inline bool
+read_log_cache(const std::filesystem::path&              cache,
+               const std::vector<std::filesystem::path>& files,
+               float                                     particles_per_history,
+               log_field_t&                              field) {
+    if (!std::filesystem::exists(cache)) return false;
+    mqi::mapped_file map(cache.string());
+    const char*      p    = map.begin();
+    auto             take = [&](void* dst, size_t n) {
+        if (size_t(map.end() - p) < n) return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+    char     magic[sizeof(log_cache_magic)];
+    uint32_t version, n_files;
+    float    pph;
+    if (!take(magic, sizeof(magic)) || std::memcmp(magic, log_cache_magic, sizeof(magic)) != 0 ||
+        !take(&version, 4) || version != log_cache_version || !take(&pph, 4) ||
+        pph != particles_per_history || !take(&n_files, 4) || n_files != files.size())
+        return false;
+
+    std::vector<uint64_t> n_samples(n_files);
+    field.energy.resize(n_files);
+    for (uint32_t i = 0; i < n_files; ++i) {
+        file_key_t key(files[i]);
+        uint32_t   len;
+        uint64_t   size;
+        int64_t    mtime;
+        if (!take(&len, 4) || len != key.name.size() || size_t(map.end() - p) < len ||
+            key.name.compare(0, len, p, len) != 0)
+            return false;
+        p += len;
+        if (!take(&size, 8) || size != key.size || !take(&mtime, 8) || mtime != key.mtime ||
+            !take(&field.energy[i], 4) || !take(&n_samples[i], 8))
+            return false;
+    }
+    field.layers.resize(n_files);
+    for (uint32_t i = 0; i < n_files; ++i) {
+        logfile_t& log = field.layers[i];
+        size_t     n   = n_samples[i];
+        log.time.resize(n);
+        log.posX.resize(n);
+        log.posY.resize(n);
+        log.muCount.resize(n);
+        log.mu.resize(n);
+        if (!take(log.time.data(), n * sizeof(float)) || !take(log.posX.data(), n * sizeof(float)) ||
+            !take(log.posY.data(), n * sizeof(float)) ||
+            !take(log.muCount.data(), n * sizeof(int)) || !take(log.mu.data(), n * sizeof(double)))
+            return false;
+    }
+    return p == map.end();
+}
+
+///< Write the cache of files, replacing an old one atomically.
+///< A cache that can not be written, e.g. in a read-only log directory, is skipped.
+inline void
+write_log_cache(const std::filesystem::path&              cache,
+                const std::vector<std::filesystem::path>& files,
+                float                                     particles_per_history,
+                const log_field_t&                        field) {
+    std::filesystem::path tmp = cache;
+    tmp += ".tmp";
+    {
+        std::ofstream fs(tmp, std::ios::binary | std::ios::trunc);
+        if (!fs) {
+            printf("Writing log file cache.. : Can not write %s, skipped\n", tmp.string().c_str());
+            return;
+        }
+        uint32_t n_files = files.size();
+        fs.write(log_cache_magic, sizeof(log_cache_magic));
+        fs.write(reinterpret_cast<const char*>(&log_cache_version), 4);
+        fs.write(reinterpret_cast<const char*>(&particles_per_history), 4);
+        fs.write(reinterpret_cast<const char*>(&n_files), 4);
+        for (uint32_t i = 0; i < n_files; ++i) {
+            file_key_t key(files[i]);
+            uint32_t   len = key.name.size();
+            uint64_t   n   = field.layers[i].muCount.size();
+            fs.write(reinterpret_cast<const char*>(&len), 4);
+            fs.write(key.name.data(), len);
+            fs.write(reinterpret_cast<const char*>(&key.size), 8);
+            fs.write(reinterpret_cast<const char*>(&key.mtime), 8);
+            fs.write(reinterpret_cast<const char*>(&field.energy[i]), 4);
+            fs.write(reinterpret_cast<const char*>(&n), 8);
+        }
+        for (const logfile_t& log : field.layers) {
+            size_t n = log.muCount.size();
+            fs.write(reinterpret_cast<const char*>(log.time.data()), n * sizeof(float));
+            fs.write(reinterpret_cast<const char*>(log.posX.data()), n * sizeof(float));
+            fs.write(reinterpret_cast<const char*>(log.posY.data()), n * sizeof(float));
+            fs.write(reinterpret_cast<const char*>(log.muCount.data()), n * sizeof(int));
+            fs.write(reinterpret_cast<const char*>(log.mu.data()), n * sizeof(double));
+        }
+        if (!fs) {
+            printf("Writing log file cache.. : Failed to write %s, skipped\n", tmp.string().c_str());
+            fs.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, cache, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+///< Read the layer files of a field, from the cache in its folder when it is up to date.
+///< Otherwise the energies are taken from the file names, the files are parsed concurrently by
+///< n_workers and the cache is rewritten.
+inline log_field_t
+read_log_field(const log_field_files_t& field_files,
+               float                    particles_per_history,
+               uint32_t                 n_workers,
+               bool                     use_cache = true) {
+    const std::vector<std::filesystem::path>& files = field_files.files;
+    log_field_t                               field;
+    if (files.empty()) return field;
+    std::filesystem::path cache = field_files.dir / log_cache_name;
+    if (use_cache && read_log_cache(cache, files, particles_per_history, field)) {
+        printf("Reading log files.. : Loaded from cache %s\n", cache.string().c_str());
+        return field;
+    }
+    for (const std::filesystem::path& file : files) {
+        field.energy.push_back(log_layer_energy(file.filename().string()));
+    }
+    field.layers.resize(files.size());
+    mqi::parallel_for(files.size(), n_workers, [&](size_t k) {
+        field.layers[k] = mqi::read_logfile(files[k].string(), particles_per_history);
+    });
+    if (use_cache) write_log_cache(cache, files, particles_per_history, field);
+    return field;
+}
+
+}   // namespace mqi
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef MQI_MAPPED_FILE_HPP
+#define MQI_MAPPED_FILE_HPP
+
+/// \file
+///
+/// Memory mapping of a whole file for parsers and caches that work on the bytes in place.
+/// Where mmap is not available or fails, the file is read into a buffer instead.
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MQI_HAS_MMAP 1
+#endif
+
+namespace mqi
+{
+
+///< Fingerprint of a file for on-disk caches
+struct file_key_t {
+    std::string name;
+    uint64_t    size  = 0;
+    int64_t     mtime = 0;   ///< file clock ticks
+
+    file_key_t(const std::filesystem::path& file) :
+        name(file.filename().string()), size(std::filesystem::file_size(file)),
+        mtime(std::filesystem::last_write_time(file).time_since_epoch().count()) {
+        ;
+    }
+};
+
+///< Keys of the files in dir, sorted by name. Cache files of moqui are skipped.
+inline std::vector<file_key_t>
+dir_file_keys(const std::string& dir) {
+    std::vector<std::filesystem::path> files;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().filename().string().compare(0, 7, ".moqui_") == 0) continue;
+        files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    return std::vector<file_key_t>(files.begin(), files.end());
+}
+
+class mapped_file
+{
+protected:
+    const char*       data_   = nullptr;
+    size_t            size_   = 0;
+    bool              mapped_ = false;
+    std::vector<char> buffer_;   ///< fallback storage when the file is not mapped
+
+public:
+    /// Map filename, throws std::runtime_error if it can not be opened.
+    /// A writable mapping is private: writes are copy-on-write and never reach the file.
+    explicit mapped_file(const std::string& filename, bool writable = false) {
+#if defined(MQI_HAS_MMAP)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (::fstat(fd, &st) == 0) {
+                size_ = static_cast<size_t>(st.st_size);
+                if (size_ == 0) {
+                    ::close(fd);
+                    return;
+                }
+                int   prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+                void* p    = ::mmap(nullptr, size_, prot, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    ::madvise(p, size_, MADV_SEQUENTIAL);
+                    data_   = static_cast<const char*>(p);
+                    mapped_ = true;
+                }
+            }
+            ::close(fd);
+            if (mapped_) return;
+        }
+#endif
+        std::ifstream fs(filename, std::ios::binary | std::ios::ate);
+        if (!fs) throw std::runtime_error("Can not open " + filename);
+        size_ = static_cast<size_t>(fs.tellg());
+        buffer_.resize(size_);
+        fs.seekg(0);
+        fs.read(buffer_.data(), size_);
+        data_ = buffer_.data();
+    }
+
+    ~mapped_file() {
+#if defined(MQI_HAS_MMAP)
+        if (mapped_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file&
+    operator=(const mapped_file&) = delete;
+
+    const char*
+    data() const {
+        return data_;
+    }
+
+    /// Bytes of a writable mapping
+    char*
+    writable_data() {
+        return const_cast<char*>(data_);
+    }
+
+    size_t
+    size() const {
+        return size_;
+    }
+
+    const char*
+    begin() const {
+        return data_;
+    }
+
+    const char*
+    end() const {
+        return data_ + size_;
+    }
+};
+
+}   // namespace mqi
+
+#endif
@@ -6,6 +6,7 @@
 /// A header including CUDA related headers and functions
 
 #include <moqui/base/mqi_common.hpp>
+#include <moqui/base/mqi_philox.hpp>
 
 #include <cmath>
 #include <mutex>
@@ -450,46 +451,41 @@ mqi_isnan(double s) {
     return std::isnan(s);
 }
 
-//compile: ERROR
-typedef std::default_random_engine mqi_rng;
-//typedef std::mt19937 mqi_rng;
+///< counter-based generator, restarted per history by the host transport
+typedef mqi::philox_rng mqi_rng;
+//typedef std::default_random_engine mqi_rng;
 
 template<>
 float
 mqi_uniform<float>(mqi_rng* rng) {
-    std::uniform_real_distribution<float> dist;
-    return dist(*rng);
+    return rng->uniform_float();
 }
 
 template<>
 double
 mqi_uniform<double>(mqi_rng* rng) {
-    std::uniform_real_distribution<double> dist;
-    return dist(*rng);
+    return rng->uniform_double();
 }
 
 template<>
 float
 mqi_normal<float>(mqi_rng* rng, float avg, float sig) {
-    std::normal_distribution<float> dist(avg, sig);
-    return dist(*rng);
+    return avg + sig * static_cast<float>(rng->normal());
 }
 
 template<>
 double
 mqi_normal<double>(mqi_rng* rng, double avg, double sig) {
-    std::normal_distribution<double> dist(avg, sig);
-    return dist(*rng);
+    return avg + sig * rng->normal();
 }
 
 template<>
 float
 mqi_exponential<float>(mqi_rng* rng, float avg, float up) {
-    float                                x;
-    std::exponential_distribution<float> dist(avg);
-    x = dist(*rng);
+    float x;
+    x = -std::log(rng->uniform_float()) / avg;
     //    do {
-    //        x = dist(*rng);
+    //        x = -std::log(rng->uniform_float()) / avg;
     //    } while (x > up || x <= 0);
     return x;
 }
@@ -497,10 +493,9 @@ mqi_exponential<float>(mqi_rng* rng, float avg, float up) {
 template<>
 double
 mqi_exponential<double>(mqi_rng* rng, double avg, double up) {
-    double                                x;
-    std::exponential_distribution<double> dist(avg);
+    double x;
     do {
-        x = dist(*rng);
+        x = -std::log(rng->uniform_double()) / avg;
     } while (x > up || x <= 0);
     return x;
 }
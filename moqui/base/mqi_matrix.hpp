@@ -65,6 +65,9 @@ public:
         zz = ref.zz;
     }
 
+    mat3x3&
+    operator=(const mat3x3& ref) = default;
+
     CUDA_HOST_DEVICE
     mat3x3(T a, T b, T c) :
         x(a), y(b), z(c), xx(1.0), xy(0), xz(0), yx(0), yy(1.0), yz(0), zx(0), zy(0), zz(1.0) {
@@ -3,6 +3,7 @@
 
 #include <moqui/base/mqi_grid3d.hpp>
 #include <moqui/base/mqi_scorer.hpp>
+#include <moqui/base/materials/mqi_density_table.hpp>
 
 #if defined(__CUDACC__)
 #include <cuda_fp16.h>
@@ -31,6 +32,17 @@ struct node_t {
     mqi::key_value** scorers_count    = nullptr;
     mqi::key_value** scorers_mean     = nullptr;
     mqi::key_value** scorers_variance = nullptr;
+    double**         scorers_dense    = nullptr;   ///< dense_ of each scorer, nullptr if not dense
+
+    ///< majorant density of geo, > 0 enables delta (Woodcock) tracking in this node
+    R rho_majorant = 0;
+
+    ///< empty-space distance map of geo (see mqi::build_empty_space_map), nullptr if unused
+    uint8_t* empty_space      = nullptr;
+    R        empty_space_step = 0;   ///< length of one map unit, the smallest voxel spacing
+
+    ///< stopping power ratio and radiation length per density bin, exact terms if bins is nullptr
+    density_table_t<R> density_table;
 
     uint16_t           n_children = 0;
     struct node_t<R>** children   = nullptr;
@@ -388,10 +388,10 @@ public:
         }
         assert(dE * r >= 0);
         ///< Multiple Coulomb SCattering (MSC)
-        R P                    = rel.momentum();
-        R radiation_length_mat = this->radiation_length(mat.rho_mass);
+        R P = rel.momentum();
 
-        R th_sq = ((this->Es / P) * (this->Es / P) / rel.beta_sq) * len / radiation_length_mat;
+        R th_sq = ((this->Es / P) * (this->Es / P) / rel.beta_sq) * len *
+                  mat.inverse_radiation_length();
         R th    = mqi::mqi_sqrt(th_sq);
         th      = mqi::mqi_normal<R>(rng, 0, mqi::mqi_sqrt(2.0f) * th);
         if (th < 0) th *= -1.0;
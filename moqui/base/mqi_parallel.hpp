@@ -0,0 +1,103 @@
+#ifndef MQI_PARALLEL_HPP
+#define MQI_PARALLEL_HPP
+
+/// \file
+///
+/// Host-side helpers to spread a loop over CPU worker threads.
+/// These are only used by the CPU build and by pre-processing on the host.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mqi
+{
+
+///< Resolve the number of host worker threads from a user setting.
+///< Zero or negative values select one worker per hardware thread.
+inline uint32_t
+host_threads(int requested) {
+    if (requested > 0) return static_cast<uint32_t>(requested);
+    uint32_t n = std::thread::hardware_concurrency();
+    return (n > 0) ? n : 1;
+}
+
+///< Run fn(worker_id, begin, end) over [0, n_jobs) split into chunks of chunk_size.
+///< Workers take the next chunk from a shared atomic counter, so a worker that
+///< finishes a cheap chunk keeps taking work instead of idling behind a static split.
+///< The first exception thrown by a worker is rethrown after all workers joined.
+///< While *reserved is non-zero, that many of the highest worker ids stop taking chunks, so
+///< another stage can borrow their cores for a while; worker 0 never pauses.
+template<typename F>
+void
+parallel_for_chunks(size_t                       n_jobs,
+                    size_t                       chunk_size,
+                    uint32_t                     n_workers,
+                    F&&                          fn,
+                    const std::atomic<uint32_t>* reserved = nullptr) {
+    if (n_jobs == 0) return;
+    if (chunk_size == 0) chunk_size = 1;
+    size_t n_chunks = (n_jobs + chunk_size - 1) / chunk_size;
+    if (n_workers > n_chunks) n_workers = static_cast<uint32_t>(n_chunks);
+    if (n_workers <= 1) {
+        for (size_t begin = 0; begin < n_jobs; begin += chunk_size) {
+            fn(0u, begin, std::min(begin + chunk_size, n_jobs));
+        }
+        return;
+    }
+
+    std::atomic<size_t> next_job(0);
+    std::exception_ptr  error = nullptr;
+    std::mutex          error_mtx;
+
+    auto worker = [&](uint32_t worker_id) {
+        try {
+            while (true) {
+                while (reserved && worker_id != 0 &&
+                       worker_id + reserved->load(std::memory_order_relaxed) >= n_workers &&
+                       next_job.load(std::memory_order_relaxed) < n_jobs) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                size_t begin = next_job.fetch_add(chunk_size, std::memory_order_relaxed);
+                if (begin >= n_jobs) break;
+                fn(worker_id, begin, std::min(begin + chunk_size, n_jobs));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mtx);
+            if (!error) error = std::current_exception();
+            next_job.store(n_jobs, std::memory_order_relaxed);   ///< stop the others early
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(n_workers - 1);
+    for (uint32_t i = 1; i < n_workers; ++i) {
+        pool.emplace_back(worker, i);
+    }
+    worker(0);   ///< the calling thread works as worker 0
+    for (auto& t : pool) {
+        t.join();
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+///< Run fn(i) for i in [0, n_jobs) with one job per chunk.
+///< Convenient for coarse tasks such as slices or files.
+template<typename F>
+void
+parallel_for(size_t n_jobs, uint32_t n_workers, F&& fn) {
+    parallel_for_chunks(n_jobs, 1, n_workers, [&](uint32_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            fn(i);
+        }
+    });
+}
+
+}   // namespace mqi
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef MQI_PHILOX_HPP
+#define MQI_PHILOX_HPP
+
+/// \file
+///
+/// Counter-based random number generator (Philox4x32-10, Salmon et al., SC'11) for host transport.
+/// A number is a pure function of (key, counter), so every history gets its own stream keyed by
+/// (seed, beam) and counted by (history, spot). Results do not depend on which worker thread
+/// transports a history, and no generator state has to be seeded or advanced between histories.
+/// The source sampling uses the same generator with source_stream set in the stream, so
+/// primary vertices and their transport never share numbers.
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace mqi
+{
+
+class philox_rng
+{
+public:
+    typedef uint32_t result_type;
+
+    static const uint32_t source_stream = 0x80000000u;   ///< stream bit of source sampling
+
+protected:
+    uint32_t key_[2]     = { 0, 0 };         ///< seed, beam
+    uint32_t ctr_[4]     = { 0, 0, 0, 0 };   ///< draw, history (lo, hi), spot
+    uint32_t out_[4]     = { 0, 0, 0, 0 };
+    uint8_t  n_out_      = 0;       ///< unused numbers left in out_
+    uint64_t first_      = 0;       ///< history index of local history 0, see start_history()
+    bool     has_normal_ = false;
+    double   normal_     = 0;       ///< second Box-Muller deviate
+
+    static inline void
+    mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+        uint64_t p = uint64_t(a) * b;
+        hi         = uint32_t(p >> 32);
+        lo         = uint32_t(p);
+    }
+
+    ///< ten Philox rounds on ctr_ with key_ into out_
+    inline void
+    generate() {
+        uint32_t c[4] = { ctr_[0], ctr_[1], ctr_[2], ctr_[3] };
+        uint32_t k[2] = { key_[0], key_[1] };
+        for (int r = 0; r < 10; ++r) {
+            uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(0xD2511F53u, c[0], hi0, lo0);
+            mulhilo(0xCD9E8D57u, c[2], hi1, lo1);
+            c[0] = hi1 ^ c[1] ^ k[0];
+            c[1] = lo1;
+            c[2] = hi0 ^ c[3] ^ k[1];
+            c[3] = lo0;
+            k[0] += 0x9E3779B9u;
+            k[1] += 0xBB67AE85u;
+        }
+        for (int i = 0; i < 4; ++i) {
+            out_[i] = c[i];
+        }
+        ++ctr_[0];
+        n_out_ = 4;
+    }
+
+public:
+    philox_rng(uint64_t seed = 0, uint32_t stream = 0) {
+        this->seed(seed, stream);
+    }
+
+    ///< Key the generator by seed and stream (the beam) and restart at history 0
+    inline void
+    seed(uint64_t seed, uint32_t stream = 0) {
+        key_[0] = uint32_t(seed) ^ uint32_t(seed >> 32);
+        key_[1] = stream;
+        first_  = 0;
+        start_history(0);
+    }
+
+    ///< Global index of the history that start_history(0) refers to
+    inline void
+    set_first_history(uint64_t first) {
+        first_ = first;
+    }
+
+    ///< Restart the stream of history first + i of a spot
+    inline void
+    start_history(uint64_t i, uint32_t spot = 0) {
+        uint64_t h  = first_ + i;
+        ctr_[0]     = 0;
+        ctr_[1]     = uint32_t(h);
+        ctr_[2]     = uint32_t(h >> 32);
+        ctr_[3]     = spot;
+        n_out_      = 0;
+        has_normal_ = false;
+    }
+
+    static constexpr result_type
+    min() {
+        return 0;
+    }
+
+    static constexpr result_type
+    max() {
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    inline result_type
+    operator()() {
+        if (n_out_ == 0) generate();
+        return out_[--n_out_];
+    }
+
+    ///< uniform in (0, 1], like curand_uniform(), so log(u) is finite
+    inline float
+    uniform_float() {
+        return ((*this)() >> 8) * (1.0f / 16777216.0f) + (1.0f / 16777216.0f);
+    }
+
+    inline double
+    uniform_double() {
+        uint64_t a = (*this)() >> 5;
+        uint64_t b = (*this)() >> 6;
+        return (a * 67108864.0 + b + 1.0) * (1.0 / 9007199254740992.0);
+    }
+
+    ///< standard normal deviate, Box-Muller with the second value kept for the next call
+    inline double
+    normal() {
+        if (has_normal_) {
+            has_normal_ = false;
+            return normal_;
+        }
+        double r    = std::sqrt(-2.0 * std::log(uniform_double()));
+        double phi  = 6.283185307179586 * uniform_double();
+        normal_     = r * std::sin(phi);
+        has_normal_ = true;
+        return r * std::cos(phi);
+    }
+};
+
+}   // namespace mqi
+
+#endif
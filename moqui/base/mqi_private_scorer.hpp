@@ -0,0 +1,195 @@
+#ifndef MQI_PRIVATE_SCORER_HPP
+#define MQI_PRIVATE_SCORER_HPP
+
+/// \file
+///
+/// Thread-private tiled accumulation for direct-mapped scorers (dose, energy deposit) on the host.
+/// Workers add hits to their own lazily allocated tiles instead of the shared scorer storage,
+/// which removes the contention on the Bragg-peak voxels of a spot.
+/// At the end of a batch the tiles are merged pairwise and flushed into the scorer tables.
+
+#if !defined(__CUDACC__)
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include <moqui/base/mqi_hash_table.hpp>
+#include <moqui/base/mqi_parallel.hpp>
+
+namespace mqi
+{
+
+///< Private tiles of one worker for one scorer table
+struct score_tiles {
+    std::vector<double*> tiles;   ///< nullptr until a voxel of the tile is hit
+};
+
+class private_scorer
+{
+public:
+    static const uint32_t tile_size = 4096;   ///< voxels per tile, 32 kB of doubles
+
+protected:
+    uint32_t                              n_workers_;
+    size_t                                max_tiles_;   ///< tiles allowed by the memory budget
+    std::atomic<size_t>                   allocated_tiles_;
+    std::atomic<bool>                     exhausted_;
+    std::vector<const void*>              targets_;   ///< key_value table or dense array
+    std::vector<key_value*>               tables_;
+    std::vector<double*>                  dense_;
+    std::vector<uint32_t>                 n_voxels_;
+    std::vector<uint32_t>                 capacities_;
+    std::vector<std::vector<score_tiles>> workers_;   ///< [worker][table]
+
+public:
+    /// \param n_workers number of host workers scoring concurrently
+    /// \param memory_budget bytes allowed for the private tiles of all workers together
+    CUDA_HOST
+    private_scorer(uint32_t n_workers, size_t memory_budget) :
+        n_workers_(n_workers), max_tiles_(memory_budget / (tile_size * sizeof(double))),
+        allocated_tiles_(0), exhausted_(false), workers_(n_workers) {
+        ;
+    }
+
+    CUDA_HOST
+    ~private_scorer() {
+        for (auto& worker : workers_) {
+            for (auto& t : worker) {
+                for (auto& tile : t.tiles) {
+                    delete[] tile;
+                }
+            }
+        }
+    }
+
+    ///< Register a direct-mapped table whose slot is the voxel index
+    CUDA_HOST
+    void
+    add_table(key_value* table, uint32_t n_voxels, uint32_t capacity) {
+        add_target(table, table, nullptr, n_voxels, capacity);
+    }
+
+    ///< Register a dense scorer array (scorer::dense_) of n_voxels values
+    CUDA_HOST
+    void
+    add_dense(double* dense, uint32_t n_voxels) {
+        add_target(dense, nullptr, dense, n_voxels, 0);
+    }
+
+    ///< Add value to voxel in the worker's tiles of target (a registered table or dense array).
+    ///< Returns false if the target is not registered or the memory budget is used up;
+    ///< the caller then scores into the shared storage with atomics.
+    CUDA_HOST
+    bool
+    accumulate(uint32_t worker, const void* target, key_t voxel, double value) {
+        for (size_t t = 0; t < targets_.size(); ++t) {
+            if (targets_[t] != target) continue;
+            if (voxel >= n_voxels_[t]) return false;
+            double*& tile = workers_[worker][t].tiles[voxel / tile_size];
+            if (tile == nullptr) {
+                if (allocated_tiles_.fetch_add(1, std::memory_order_relaxed) >= max_tiles_) {
+                    allocated_tiles_.fetch_sub(1, std::memory_order_relaxed);
+                    exhausted_.store(true, std::memory_order_relaxed);
+                    return false;
+                }
+                tile = new double[tile_size]();
+            }
+            tile[voxel % tile_size] += value;
+            return true;
+        }
+        return false;
+    }
+
+    ///< Merge the workers pairwise in log2(n_workers) rounds, then flush worker 0 into the targets.
+    ///< Tiles are released afterwards so the budget is available for the next batch.
+    CUDA_HOST
+    void
+    reduce() {
+        for (uint32_t stride = 1; stride < n_workers_; stride *= 2) {
+            uint32_t n_pairs = (n_workers_ + 2 * stride - 1) / (2 * stride);
+            mqi::parallel_for(n_pairs, n_workers_, [&](size_t p) {
+                uint32_t dst = p * 2 * stride;
+                uint32_t src = dst + stride;
+                if (src < n_workers_) merge(workers_[dst], workers_[src]);
+            });
+        }
+        for (size_t t = 0; t < targets_.size(); ++t) {
+            std::vector<double*>& tiles = workers_[0][t].tiles;
+            mqi::parallel_for(tiles.size(), n_workers_, [&](size_t k) {
+                if (tiles[k] == nullptr) return;
+                uint32_t v0 = k * tile_size;
+                uint32_t v1 = std::min<uint32_t>(v0 + tile_size, n_voxels_[t]);
+                for (uint32_t v = v0; v < v1; ++v) {
+                    double value = tiles[k][v - v0];
+                    if (value <= 0) continue;
+                    if (dense_[t]) {
+                        mqi::atomic_add(&dense_[t][v], value);
+                    } else {
+                        insert_key_value(tables_[t], v, v, 0, value, capacities_[t]);
+                    }
+                }
+                delete[] tiles[k];
+                tiles[k] = nullptr;
+            });
+        }
+        allocated_tiles_.store(0);
+        if (exhausted_.exchange(false)) {
+            printf("Private scoring.. : Memory budget was reached, remaining hits were scored to shared tables\n");
+        }
+    }
+
+protected:
+    CUDA_HOST
+    void
+    add_target(const void* target,
+               key_value*  table,
+               double*     dense,
+               uint32_t    n_voxels,
+               uint32_t    capacity) {
+        targets_.push_back(target);
+        tables_.push_back(table);
+        dense_.push_back(dense);
+        n_voxels_.push_back(n_voxels);
+        capacities_.push_back(capacity);
+        uint32_t n_tiles = (n_voxels + tile_size - 1) / tile_size;
+        for (auto& worker : workers_) {
+            worker.emplace_back();
+            worker.back().tiles.assign(n_tiles, nullptr);
+        }
+        size_t full_copy = size_t(n_tiles) * n_workers_;
+        printf("Private scoring.. : %s private copy per worker (budget %lu tiles, full copy %lu tiles)\n",
+               (full_copy <= max_tiles_) ? "Full" : "Partial",
+               max_tiles_,
+               full_copy);
+    }
+
+    ///< Add src tiles into dst; tiles missing in dst are moved instead of copied
+    CUDA_HOST
+    void
+    merge(std::vector<score_tiles>& dst, std::vector<score_tiles>& src) {
+        for (size_t t = 0; t < dst.size(); ++t) {
+            for (size_t k = 0; k < dst[t].tiles.size(); ++k) {
+                double*& s = src[t].tiles[k];
+                if (s == nullptr) continue;
+                double*& d = dst[t].tiles[k];
+                if (d == nullptr) {
+                    d = s;
+                } else {
+                    for (uint32_t v = 0; v < tile_size; ++v) {
+                        d[v] += s[v];
+                    }
+                    delete[] s;
+                    allocated_tiles_.fetch_sub(1, std::memory_order_relaxed);
+                }
+                s = nullptr;
+            }
+        }
+    }
+};
+
+}   // namespace mqi
+
+#endif
+
+#endif
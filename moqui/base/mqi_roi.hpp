@@ -78,7 +78,7 @@ public:
         case INDIRECT:
             return length_;
         case CONTOUR:
-            return acc_stride_[length_ - 1];
+            return (length_ > 0) ? acc_stride_[length_ - 1] : 0;
         default:
             return original_length_;
         }
@@ -87,7 +87,8 @@ public:
     CUDA_HOST_DEVICE
     int32_t
     get_contour_idx(const uint32_t& v) const {
-        int32_t  c        = this->lower_bound_cpp(v) - 1;
+        int32_t c = this->lower_bound_cpp(v) - 1;
+        if (c < 0) return -1;   /// before the first stride
         uint32_t distance = v - start_[c];
         if (distance < stride_[c]) {
             /// is in stride
@@ -100,7 +101,8 @@ public:
     CUDA_HOST_DEVICE
     int32_t
     idx_contour(const uint32_t& v) const {
-        int32_t  c        = this->lower_bound_cpp(v) - 1;
+        int32_t c = this->lower_bound_cpp(v) - 1;
+        if (c < 0) return -1;   /// before the first stride
         uint32_t distance = v - start_[c];
         if (distance < stride_[c]) {
             /// is in stride
@@ -1,7 +1,7 @@
 #ifndef MQI_SCORER_HPP
 #define MQI_SCORER_HPP
 
-#include <mutex>
+#include <cassert>
 
 #include <moqui/base/mqi_common.hpp>
 #include <moqui/base/mqi_hash_table.hpp>
@@ -49,6 +49,12 @@ public:
     uint32_t        max_capacity_     = 0;   //// Max capacity is 32-bit integer
     uint32_t        current_capacity_ = 0;   //// Max capacity is 32-bit integer
 
+    ///< Dense storage: one value per ROI voxel, indexed by roi_->get_mask_idx(cnb).
+    ///< Set for scorers without spot keys (dose, energy deposit, LET); data_ is unused then.
+    ///< Dense scorers keep no variance: count_, mean_ and variance_ are per-voxel hash tables.
+    double*  dense_      = nullptr;
+    uint32_t dense_size_ = 0;
+
     scorer_t type_;   //< TODO: will be gone
 
     ///< Region of interest how to map transport pixel to scoring pixel
@@ -60,12 +66,6 @@ public:
     mqi::key_value* mean_           = nullptr;
     mqi::key_value* variance_       = nullptr;
 
-#if defined(__CUDACC__)
-
-#else
-    std::mutex mtx;
-#endif
-
     ///< Construct with size
     CUDA_HOST_DEVICE
     scorer(const char* name, const uint32_t max_capacity, const fp_compute_hit<R> func_pointer) :
@@ -83,6 +83,7 @@ public:
     void
     delete_data_if_used(void) {
         if (data_ != nullptr) delete[] data_;
+        if (dense_ != nullptr) delete[] dense_;
         if (count_ != nullptr) delete[] count_;
         if (mean_ != nullptr) delete[] mean_;
         if (variance_ != nullptr) delete[] variance_;
@@ -98,17 +99,6 @@ public:
         return k % (this->max_capacity_ - 1);
     }
 
-    CUDA_HOST_DEVICE
-    uint32_t
-    CAS(uint32_t* address, uint32_t compare, uint32_t val) {
-        uint32_t old = *address;
-        if (old == compare) {
-            *address = val;
-        } else {
-        }
-        return old;
-    }
-
     CUDA_DEVICE
     void
     insert_pair(mqi::key_t key1, mqi::key_t key2, R value, unsigned long long int scorer_offset) {
@@ -120,26 +110,58 @@ public:
             slot = hash_fun(key1 + (key2 * scorer_offset));
         }
 
+#if defined(__CUDACC__)
         uint32_t prev1, prev2;
         while (true) {
-#if defined(__CUDACC__)
             prev1 = atomicCAS(&this->data_[slot].key1, mqi::empty_pair, key1);
             prev2 = atomicCAS(&this->data_[slot].key2, mqi::empty_pair, key2);
-#else
-            prev1 = CAS(&this->data_[slot].key1, mqi::empty_pair, key1);
-            prev2 = CAS(&this->data_[slot].key2, mqi::empty_pair, key2);
-#endif
             if ((prev1 == mqi::empty_pair || prev1 == key1) &&
                 (prev2 == mqi::empty_pair || prev2 == key2)) {
-#if defined(__CUDACC__)
                 atomicAdd(&this->data_[slot].value, value);
-#else
-                this->data_[slot].value += value;
-#endif
                 return;
             }
             slot = (slot + 1) % (this->max_capacity_ - 1);
         }
+#else
+        mqi::insert_key_value(this->data_, slot, key1, key2, value, this->max_capacity_);
+#endif
+    }
+
+    ///< add a value to the dense storage at ROI index idx
+    CUDA_DEVICE
+    void
+    add_dense(int32_t idx, double value) {
+#if defined(__CUDACC__)
+        atomicAdd(&this->dense_[idx], value);
+#else
+        mqi::atomic_add(&this->dense_[idx], value);
+#endif
+    }
+
+    ///< Scatter dense_ into a volume of n voxels of the transport grid
+    CUDA_HOST
+    void
+    dense_to_volume(double* dest, uint32_t n) const {
+        switch (roi_->method_) {
+        case CONTOUR:
+            for (uint32_t c = 0; c < roi_->length_; ++c) {
+                uint32_t base = (c > 0) ? roi_->acc_stride_[c - 1] : 0;
+                for (uint32_t j = 0; j < roi_->stride_[c] && roi_->start_[c] + j < n; ++j) {
+                    dest[roi_->start_[c] + j] += dense_[base + j];
+                }
+            }
+            break;
+        case INDIRECT:
+            for (uint32_t v = 0; v < n && v < roi_->original_length_; ++v) {
+                int32_t m = roi_->get_mask_idx(v);
+                if (m >= 0) dest[v] += dense_[m];
+            }
+            break;
+        default:
+            for (uint32_t v = 0; v < n && v < dense_size_; ++v) {
+                dest[v] += dense_[v];
+            }
+        }
     }
 
     ///< process hit for Dij matrix?
@@ -158,6 +180,13 @@ public:
         ///< calculate quantity
         R quantity = (*this->compute_hit_)(trk, cnb, geo);
 
+        if (this->dense_) {
+            assert(!this->score_variance_);
+            int32_t m = roi_->get_mask_idx(cnb);
+            if (m >= 0 && quantity > 0) add_dense(m, quantity);
+            return;
+        }
+
         ///< store quantity and variance if it is set.
 #if defined(__CUDACC__)
         insert_pair(cnb, offset, quantity, scorer_offset);
@@ -169,17 +198,16 @@ public:
             atomicAdd(&variance_[cnb].value, delta * (quantity - mean_[cnb].value));
         }
 #else
-        mtx.lock();
         insert_pair(cnb, offset, quantity, scorer_offset);
-        data_[idx].value += quantity;
+
         if (this->score_variance_) {
+            ///< the Welford update reads the tables it writes, so it runs under the voxel lock
+            mqi::voxel_lock_guard lock(cnb);
             count_[cnb].value += 1.0;
             R delta = quantity - mean_[cnb].value;
             mean_[cnb].value += delta / count_[cnb].value;
             variance_[cnb].value += delta * (quantity - mean_[cnb].value);
         }
-
-        mtx.unlock();
 #endif
     }
 
@@ -188,7 +216,8 @@ public:
     CUDA_HOST
     void
     clear_data() {
-        std::memset(data_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
+        if (dense_ != nullptr) std::memset(dense_, 0, sizeof(double) * this->dense_size_);
+        if (data_ != nullptr) std::memset(data_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
         if (this->score_variance_) {
             std::memset(count_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
             std::memset(mean_, 0xff, sizeof(mqi::key_value) * this->max_capacity_);
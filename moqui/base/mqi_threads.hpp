@@ -26,9 +26,10 @@ initialize_threads(mqi::thrd_t*   thrds,
     uint32_t thread_id = blockIdx.x * blockDim.x + threadIdx.x;
     curand_init(master_seed + blockIdx.x, threadIdx.x, offset, &thrds[thread_id].rnd_generator);
 #else
+    ///< host streams are keyed by (seed, offset) and restarted per history by the transport,
+    ///< so the numbers of a history do not depend on the thread that transports it
     for (uint32_t i = 0; i < n_threads; ++i) {
-        std::seed_seq seed{ master_seed + i };
-        thrds[i].rnd_generator.seed(master_seed);
+        thrds[i].rnd_generator.seed(master_seed, offset);
     }
 #endif
 }
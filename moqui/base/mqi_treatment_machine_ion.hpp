@@ -24,6 +24,18 @@ class treatment_machine_ion : public treatment_machine<T>
 {
 
 protected:
+    /// Spot table of the log file beamsource being created, nullptr otherwise
+    mqi::spot_table<T>* spot_table_ = nullptr;
+
+    /// Spot table of beamlets characterized outside create_beamsource, they live with the machine
+    mqi::spot_table<T> machine_spots_;
+
+    /// Spot table that log spots are added to
+    mqi::spot_table<T>*
+    log_spot_table() {
+        return this->spot_table_ ? this->spot_table_ : &this->machine_spots_;
+    }
+
 public:
     /// Default constructor
     treatment_machine_ion() {
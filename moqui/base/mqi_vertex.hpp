@@ -18,6 +18,10 @@ struct vertex_t {
     vec3<T> pos;   //< position
     vec3<T> dir;   //< direction
 
+    vertex_t() = default;
+
+    vertex_t(const vertex_t<T>& rhs) = default;
+
     CUDA_HOST_DEVICE
     vertex_t<T>&
     operator=(const vertex_t<T>& rhs) {
@@ -45,7 +45,7 @@ dose_to_water(const track_t<R>& trk, const cnb_t& cnb, grid3d<mqi::density_t, R>
     if (density < 1.0e-7) {
         return 0.0;
     } else {
-        water.rho_mass = density;
+        water.set_density(density, trk.c_node->density_table);
         return (trk.dE + trk.local_dE) * 1.60218e-10 /
                (volume * density * water.stopping_power_ratio(trk.vtx0.ke));
     }
@@ -60,6 +60,14 @@ download_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
           scrs, tmp.scorers_data, tmp.n_scorers * sizeof(mqi::key_value*), cudaMemcpyDeviceToHost));
         gpu_err_chk(cudaFree(tmp.scorers_data));
 
+        double** scors_dense = nullptr;
+        if (tmp.scorers_dense) {
+            scors_dense = new double*[tmp.n_scorers];
+            gpu_err_chk(cudaMemcpy(
+              scors_dense, tmp.scorers_dense, tmp.n_scorers * sizeof(double*), cudaMemcpyDeviceToHost));
+            gpu_err_chk(cudaFree(tmp.scorers_dense));
+        }
+
         if (mc::mc_score_variance) {
             gpu_err_chk(cudaMemcpy(scors_count,
                                    tmp.scorers_count,
@@ -82,6 +90,13 @@ download_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                    c_node->scorers[i]->max_capacity_ * sizeof(mqi::key_value),
                                    cudaMemcpyDeviceToHost));
             gpu_err_chk(cudaFree(scrs[i]));
+            if (scors_dense && scors_dense[i]) {
+                gpu_err_chk(cudaMemcpy(c_node->scorers[i]->dense_,
+                                       scors_dense[i],
+                                       c_node->scorers[i]->dense_size_ * sizeof(double),
+                                       cudaMemcpyDeviceToHost));
+                gpu_err_chk(cudaFree(scors_dense[i]));
+            }
             if (c_node->scorers[i]->score_variance_) {
                 gpu_err_chk(cudaMemcpy(c_node->scorers[i]->count_,
                                        scors_count[i],
@@ -99,11 +114,15 @@ download_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
             }
         }
         delete[] scrs;
+        delete[] scors_dense;
         delete[] scors_count;
         delete[] scors_mean;
         delete[] scors_var;
     }
     //    gpu_err_chk(cudaFree(g_node.geo));
+    ///< per-beam lookup tables of the geometry
+    if (tmp.empty_space) gpu_err_chk(cudaFree(tmp.empty_space));
+    if (tmp.density_table.bins) gpu_err_chk(cudaFree(tmp.density_table.bins));
 
     if (tmp.n_children > 0) {
         mqi::node_t<R>** children = new mqi::node_t<R>*[tmp.n_children];
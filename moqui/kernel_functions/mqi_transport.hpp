@@ -1,6 +1,7 @@
 #ifndef MQI_TRANSPORT_HPP
 #define MQI_TRANSPORT_HPP
 
+#include <moqui/base/mqi_beam_spot.hpp>
 #include <moqui/base/mqi_error_check.hpp>
 #include <moqui/base/mqi_fippel_physics.hpp>
 #include <moqui/base/mqi_material.hpp>
@@ -12,12 +13,24 @@
 
 #include <cassert>
 
+#if !defined(__CUDACC__)
+#include <moqui/base/mqi_parallel.hpp>
+#include <moqui/base/mqi_private_scorer.hpp>
+#endif
+
 namespace mc
 {
 
-CUDA_DEVICE
+#if !defined(__CUDACC__)
+///< Thread-private score tiles of the calling host worker.
+///< nullptr means hits go straight to the shared scorer tables.
+thread_local mqi::private_scorer* mc_private_scorer = nullptr;
+thread_local uint32_t             mc_private_worker = 0;
+#endif
+
+CUDA_HOST_DEVICE
 uint32_t
-hash_fun(uint32_t k1, uint32_t k2, uint64_t max_capacity) {
+hash_key(uint32_t k1, uint32_t k2) {
     k1 *= 0xcc9e2d5;
     k1 = (k1 << 15) | (k1 >> 17);
     k1 *= 0x1b873593;
@@ -31,18 +44,13 @@ hash_fun(uint32_t k1, uint32_t k2, uint64_t max_capacity) {
     k2 ^= k2 >> 13;
     k2 *= 0xc2b2ae35;
     k2 ^= k2 >> 16;
-    return k2 % (max_capacity);
+    return k2;
 }
 
-CUDA_HOST_DEVICE
+CUDA_DEVICE
 uint32_t
-CAS(uint32_t* address, uint32_t compare, uint32_t val) {
-    uint32_t old = *address;
-    if (old == compare) {
-        *address = val;
-    } else {
-    }
-    return old;
+hash_fun(uint32_t k1, uint32_t k2, uint64_t max_capacity) {
+    return hash_key(k1, k2) % (max_capacity);
 }
 
 template<typename R>
@@ -55,6 +63,7 @@ insert_hashtable(mqi::key_value*        hashtable,
                  uint64_t               max_capacity) {
     mqi::key_t slot;
     if (value <= 0) { return; }
+#if defined(__CUDACC__)
     if (key2 == mqi::empty_pair) {
         slot = key1;
         key2 = 0;
@@ -64,24 +73,221 @@ insert_hashtable(mqi::key_value*        hashtable,
 
     uint32_t prev1, prev2;
     while (true) {
-#if defined(__CUDACC__)
         prev1 = atomicCAS(&hashtable[slot].key1, mqi::empty_pair, key1);
         prev2 = atomicCAS(&hashtable[slot].key2, mqi::empty_pair, key2);
-#else
-        prev1 = CAS(&hashtable[slot].key1, mqi::empty_pair, key1);
-        prev2 = CAS(&hashtable[slot].key2, mqi::empty_pair, key2);
-#endif
         if ((prev1 == mqi::empty_pair || prev1 == key1) &&
             (prev2 == mqi::empty_pair || prev2 == key2)) {
-#if defined(__CUDACC__)
             atomicAdd(&hashtable[slot].value, value);
-#else
-            hashtable[slot].value += value;
-#endif
             return;
         }
         slot = (slot + 1) % (max_capacity);
     }
+#else
+    if (key2 == mqi::empty_pair) {
+        if (mc_private_scorer &&
+            mc_private_scorer->accumulate(mc_private_worker, hashtable, key1, value)) {
+            return;
+        }
+        slot = key1;
+        key2 = 0;
+    } else {
+        slot = hash_key(key1, key2);
+    }
+    mqi::insert_key_value(hashtable, slot, key1, key2, value, max_capacity);
+#endif
+}
+
+///< Add value to ROI mask index m of a dense scorer
+template<typename R>
+CUDA_DEVICE void
+insert_dense(mqi::scorer<R>* scr, int32_t m, double value) {
+    if (value <= 0) { return; }
+#if !defined(__CUDACC__)
+    if (mc_private_scorer && mc_private_scorer->accumulate(mc_private_worker, scr->dense_, m, value)) {
+        return;
+    }
+#endif
+    scr->add_dense(m, value);
+}
+
+///< Score the step of track in voxel cnb to every scorer of the track's node.
+///< Both storages score every voxel of the ROI, i.e. where roi_t::idx is not negative.
+template<typename R>
+CUDA_DEVICE void
+score_hit(mqi::track_t<R>&                track,
+          mqi::cnb_t                      cnb,
+          mqi::grid3d<mqi::density_t, R>& c_geo,
+          uint32_t                        spot_ind) {
+    for (uint8_t s = 0; s < track.c_node->n_scorers; ++s) {
+        if (track.c_node->scorers[s]->roi_->idx(cnb) < 0) continue;
+        if (track.c_node->scorers[s]->dense_) {
+            ///< dense scorers have one value per ROI voxel and no spot key
+            insert_dense<R>(track.c_node->scorers[s],
+                            track.c_node->scorers[s]->roi_->get_mask_idx(cnb),
+                            track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo));
+        } else {
+            insert_hashtable<R>(track.c_node->scorers[s]->data_,
+                                cnb,
+                                spot_ind,
+                                track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo),
+                                c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z,
+                                track.c_node->scorers[s]->max_capacity_);
+        }
+    }
+}
+
+///< Move a track through empty space (node_t::empty_space) in a single step.
+///< The step is bounded by the distance map so it cannot enter a non-empty voxel;
+///< the continuous loss in air is applied but not scored.
+///< Returns false when the voxel is not empty space and the track needs regular stepping.
+template<typename R>
+CUDA_DEVICE bool
+skip_empty_space(mqi::track_t<R>&                track,
+                 mqi::track_stack_t<R>&          stack,
+                 mqi::mqi_rng*                   rng,
+                 mqi::fippel_physics<R>&         fippel,
+                 mqi::grid3d<mqi::density_t, R>& c_geo,
+                 mqi::cnb_t                      cnb) {
+    if (track.c_node->empty_space == nullptr || track.c_node->empty_space[cnb] < 2 ||
+        track.vtx0.ke < fippel.Tp_cut) {
+        return false;
+    }
+    R len = (track.c_node->empty_space[cnb] - 1) * track.c_node->empty_space_step;
+    mqi::intersect_t<R> its = c_geo.intersect(track.vtx0.pos, track.vtx0.dir, track.its.cell);
+    if (its.dist > len) len = its.dist;
+
+    mqi::h2o_t<R> air;
+    air.set_density(c_geo[cnb], track.c_node->density_table);
+    fippel.p_ion.along_step(track, stack, rng, len, air);
+
+    ///< the step can cross several voxels, follow it along the direction of flight
+    mqi::vec3<mqi::ijk_t> prev;
+    do {
+        prev = track.its.cell;
+        c_geo.index(track.vtx1.pos, track.vtx0.dir, track.its.cell);
+    } while (c_geo.is_valid(track.its.cell) &&
+             (prev.x != track.its.cell.x || prev.y != track.its.cell.y ||
+              prev.z != track.its.cell.z));
+    if (!track.is_stopped()) track.move();
+    return true;
+}
+
+///< Delta (Woodcock) tracking of a track inside a node with rho_majorant > 0.
+///< Steps are sampled in the majorant density and are not stopped at voxel walls.
+///< The voxels under a step are walked to get the mean density for the continuous loss,
+///< and the energy loss is scored to them in proportion to their mass along the step.
+///< A candidate interaction is real with probability rho_local / rho_majorant.
+///< Returns when the track leaves the grid or stops, like the voxel-by-voxel loop.
+template<typename R>
+CUDA_DEVICE void
+transport_woodcock(mqi::track_t<R>&                track,
+                   mqi::track_stack_t<R>&          stack,
+                   mqi::mqi_rng*                   rng,
+                   mqi::fippel_physics<R>&         fippel,
+                   mqi::grid3d<mqi::density_t, R>& c_geo,
+                   uint32_t                        spot_ind,
+                   bool                            score_local_deposit) {
+    const uint8_t                  max_segments = 32;   ///< voxels per step, longer steps are cut
+    mqi::cnb_t                     seg_cnb[max_segments];
+    R                              seg_len[max_segments];
+    R                              seg_rho[max_segments];
+    R                              cs[4];
+    R                              cs_sum;
+    bool                           collision;
+    mqi::h2o_t<R>                  water;
+    const R                        rho_majorant = track.c_node->rho_majorant;
+    const mqi::density_table_t<R>& table        = track.c_node->density_table;
+    mqi::vec3<R>                   pos;
+    mqi::vec3<R>                   dir;
+    mqi::vec3<mqi::ijk_t>          cell;
+    mqi::vec3<mqi::ijk_t>          next;
+
+    while (c_geo.is_valid(track.its.cell) && !track.is_stopped()) {
+        mqi::cnb_t cnb = c_geo.ijk2cnb(track.its.cell);
+        if (skip_empty_space<R>(track, stack, rng, fippel, c_geo, cnb)) continue;
+        if (track.vtx0.ke < fippel.Tp_cut) {
+            ///< deposit the rest in the current voxel
+            water.set_density(c_geo[cnb], table);
+            fippel.stepping(track, stack, rng, water.rho_mass, water, 0, score_local_deposit);
+            score_hit<R>(track, cnb, c_geo, spot_ind);
+            break;
+        }
+
+        water.set_density(rho_majorant, table);
+        R len          = fippel.woodcock_step(track, rng, water, cs, cs_sum, collision);
+
+        ///< walk the voxels under the step
+        pos            = track.vtx0.pos;
+        dir            = track.vtx0.dir;
+        cell           = track.its.cell;
+        R       walked = 0.0;
+        R       mass   = 0.0;
+        uint8_t n      = 0;
+        while (true) {
+            mqi::intersect_t<R> its = c_geo.intersect(pos, dir, cell);
+            R                   l   = len - walked;
+            if (its.dist >= 0 && its.dist < l) l = its.dist;
+            seg_cnb[n] = c_geo.ijk2cnb(cell);
+            seg_rho[n] = c_geo[seg_cnb[n]];
+            seg_len[n] = l;
+            mass += l * seg_rho[n];
+            walked += l;
+            ++n;
+            if (walked >= len) break;
+            pos  = pos + track.vtx0.dir * l;
+            next = cell;
+            c_geo.index(pos, dir, next);
+            if (!c_geo.is_valid(next) || n == max_segments) {
+                ///< the step ends on the grid boundary or on the last walked voxel
+                len       = walked;
+                collision = false;
+                break;
+            }
+            cell = next;
+        }
+
+        water.set_density((len > 0) ? mass / len : seg_rho[0], table);
+        fippel.p_ion.along_step(track, stack, rng, len, water);
+        R dE_along = track.dE;
+        if (collision && !track.is_stopped() && track.vtx1.ke >= fippel.Tp_cut &&
+            mqi::mqi_uniform<R>(rng) * rho_majorant < seg_rho[n - 1]) {
+            water.set_density(seg_rho[n - 1], table);
+            fippel.interact(track, stack, rng, cs, cs_sum, len, water, score_local_deposit);
+        }
+
+        ///< a stopped track may end before the walked length
+        R travelled = (track.vtx1.pos - track.vtx0.pos).norm();
+        R scored    = 0.0;
+        mass        = 0.0;
+        for (uint8_t k = 0; k < n; ++k) {
+            if (scored + seg_len[k] > travelled) {
+                seg_len[k] = (travelled > scored) ? travelled - scored : 0;
+            }
+            scored += seg_len[k];
+            mass += seg_len[k] * seg_rho[k];
+        }
+        mqi::track_t<R> seg(track);
+        seg.vtx1.pos = track.vtx0.pos;
+        for (uint8_t k = 0; k < n; ++k) {
+            seg.vtx0.pos = seg.vtx1.pos;
+            seg.vtx1.pos = seg.vtx0.pos + track.vtx0.dir * seg_len[k];
+            seg.dE       = (mass > 0) ? dE_along * seg_len[k] * seg_rho[k] / mass : 0;
+            seg.local_dE = 0;
+            if (k == n - 1) {
+                ///< interaction deposits belong to the end point
+                seg.dE += track.dE - dE_along;
+                seg.local_dE = track.local_dE;
+                if (mass <= 0) seg.dE += dE_along;
+            }
+            score_hit<R>(seg, seg_cnb[k], c_geo, spot_ind);
+        }
+
+        track.its.cell = cell;
+        if (!track.is_stopped()) {
+            c_geo.index(track.vtx1.pos, track.vtx1.dir, track.its.cell);
+            track.move();
+        }
+    }
 }
 
 template<typename R>
@@ -93,6 +299,7 @@ transport_particles_patient(mqi::thrd_t*      threads,
                             uint32_t*         tracked_particles,
                             uint32_t*         scorer_offset_vector = nullptr,
                             bool              score_local_deposit  = true,
+                            const mqi::spot_histories_t<R>* source = nullptr,   // CPU on-the-fly
                             uint32_t          total_threads        = 1,   // # of CPU threads
                             uint32_t          thread_id            = 0)                       // CPU thread-id
 {
@@ -114,16 +321,23 @@ transport_particles_patient(mqi::thrd_t*      threads,
     mqi::intersect_t<R>       its;
     mqi::dL_t<R>              Lmin;
     mqi::cnb_t                cnb;             //< child number
-    uint8_t                   nb_of_scorers;   //< scorer number
     R                         rho_mass = 1e-3;
     ///< count for physics process rates
     for (uint32_t i = h_range.x; i < h_range.x + h_range.y; ++i) {
-        if (scorer_offset_vector) {
+        if (source) {
+            spot_ind = source->score_offset;
+        } else if (scorer_offset_vector) {
             spot_ind = scorer_offset_vector[i];
         } else {
             spot_ind = mqi::empty_pair;
         }
-        mqi::track_t<R>       primary(vertices[i]);
+#if !defined(__CUDACC__)
+        thread_rng->start_history(i, spot_ind);
+        ///< without a vertex array the primary is sampled right here
+        mqi::track_t<R> primary(source ? source->sample(i) : vertices[i]);
+#else
+        mqi::track_t<R> primary(vertices[i]);
+#endif
         mqi::track_stack_t<R> stack;
         stack.push_secondary(primary);
 
@@ -133,7 +347,6 @@ transport_particles_patient(mqi::thrd_t*      threads,
             for (c_ind = 0; c_ind < world->n_children; c_ind++) {
                 mqi::grid3d<mqi::density_t, R>& c_geo = *(world->children[c_ind]->geo);
                 track.c_node                          = world->children[c_ind];
-                nb_of_scorers                         = track.c_node->n_scorers;
                 //                track.vtx0.pos =c_geo.rotation_matrix_inv * (track.vtx0.pos - c_geo.translation_vector) +c_geo.translation_vector;   // rotate the vertex
                 //                track.vtx0.dir =c_geo.rotation_matrix_inv * (track.vtx0.dir);   // rotate the vertex
                 track.vtx0.pos =
@@ -167,12 +380,17 @@ transport_particles_patient(mqi::thrd_t*      threads,
                     track.its.dist = 0.0;
                     track.its.cell = index_checker;
                 }
+                if (track.c_node->rho_majorant > 0) {
+                    transport_woodcock<R>(
+                      track, stack, thread_rng, fippel, c_geo, spot_ind, score_local_deposit);
+                }
                 while (c_geo.is_valid(track.its.cell) && !track.is_stopped()) {
-                    cnb       = c_geo.ijk2cnb(track.its.cell);
+                    cnb = c_geo.ijk2cnb(track.its.cell);
+                    if (skip_empty_space<R>(track, stack, thread_rng, fippel, c_geo, cnb)) continue;
                     track.its = c_geo.intersect(track.vtx0.pos, track.vtx0.dir, track.its.cell);
                     rho_mass  = c_geo[cnb];
 
-                    water.rho_mass = rho_mass;
+                    water.set_density(rho_mass, track.c_node->density_table);
 #ifdef __PHYSICS_DEBUG__
                     if (!track.primary && track.dE > 0) {
                         track.stop();
@@ -195,17 +413,7 @@ transport_particles_patient(mqi::thrd_t*      threads,
                                     score_local_deposit);
 #endif
                     if (track.its.dist < 0) break;
-                    for (uint8_t s = 0; s < nb_of_scorers; ++s) {
-                        if (track.c_node->scorers[s]->roi_->idx(cnb) > 0) {
-                            insert_hashtable<R>(
-                              track.c_node->scorers[s]->data_,
-                              cnb,
-                              spot_ind,
-                              track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo),
-                              c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z,
-                              track.c_node->scorers[s]->max_capacity_);
-                        }
-                    }
+                    score_hit<R>(track, cnb, c_geo, spot_ind);
 
                     if (!track.is_stopped()) {
                         c_geo.index(track.vtx1.pos,
@@ -232,6 +440,128 @@ transport_particles_patient(mqi::thrd_t*      threads,
     }   //for
 }   //transport_particles_table
 
+#if !defined(__CUDACC__)
+///< CPU driver for transport_particles_patient.
+///< The batch is cut into chunks of chunk_size histories and the host workers
+///< pull chunks from a shared counter until the batch is exhausted.
+///< Each worker uses its own threads[worker_id] random generator and counts the
+///< tracked histories privately; the counts are summed into tracked_particles after joining.
+///< The generators restart per history at first_history + index in the batch, so the
+///< result does not depend on the number of workers or on the chunk a history falls in.
+///< When private_scores is given, direct-mapped hits are accumulated per worker and
+///< merged into the scorer tables by the caller (private_scorer::reduce).
+///< While *reserved is non-zero, that many workers pause between chunks (see parallel_for_chunks).
+template<typename R>
+CUDA_HOST void
+transport_particles_patient_host(mqi::thrd_t*                 threads,
+                                 uint32_t                     n_threads,
+                                 mqi::node_t<R>*              world,
+                                 mqi::vertex_t<R>*            vertices,
+                                 const uint32_t               n_vtx,
+                                 uint32_t*                    tracked_particles,
+                                 uint32_t*                    scorer_offset_vector = nullptr,
+                                 uint32_t                     chunk_size           = 256,
+                                 mqi::private_scorer*         private_scores       = nullptr,
+                                 bool                         score_local_deposit  = true,
+                                 uint64_t                     first_history        = 0,
+                                 const std::atomic<uint32_t>* reserved             = nullptr) {
+    std::vector<uint32_t> tracked(n_threads, 0);
+    mqi::parallel_for_chunks(
+      n_vtx,
+      chunk_size,
+      n_threads,
+      [&](uint32_t worker_id, size_t begin, size_t end) {
+          uint32_t done     = 0;
+          mc_private_scorer = private_scores;
+          mc_private_worker = worker_id;
+          threads[worker_id].rnd_generator.set_first_history(first_history + begin);
+          transport_particles_patient<R>(&threads[worker_id],
+                                         world,
+                                         vertices + begin,
+                                         end - begin,
+                                         &done,
+                                         scorer_offset_vector ? scorer_offset_vector + begin
+                                                              : nullptr,
+                                         score_local_deposit);
+          tracked[worker_id] += done;
+          mc_private_scorer = nullptr;
+      },
+      reserved);
+    for (uint32_t i = 0; i < n_threads; ++i) {
+        tracked_particles[0] += tracked[i];
+    }
+}
+
+///< CPU driver that samples the primaries inside the workers instead of reading a vertex array.
+///< Histories [first_history, first_history + n_histories) of the flat spots are cut into chunks
+///< of chunk_size; a chunk is split at spot boundaries into (spot, history range) work items
+///< that are transported with their primaries sampled one by one, so memory does not grow
+///< with the number of histories. cdf holds the accumulated histories of the n_spots spots,
+///< rotations and translations map each spot from beam to world coordinates.
+///< score_stride > 0 scores every spot separately at spot * score_stride (per-spot scoring).
+template<typename R>
+CUDA_HOST void
+transport_particles_source_host(mqi::thrd_t*                threads,
+                                uint32_t                    n_threads,
+                                mqi::node_t<R>*             world,
+                                const mqi::spot_table_t<R>* spots,
+                                const mqi::mat3x3<R>*       rotations,
+                                const mqi::vec3<R>*         translations,
+                                const size_t*               cdf,
+                                size_t                      n_spots,
+                                uint64_t                    seed,
+                                uint32_t                    stream,
+                                uint32_t                    score_stride,
+                                uint64_t                    first_history,
+                                uint64_t                    n_histories,
+                                uint32_t*                   tracked_particles,
+                                uint32_t                    chunk_size          = 256,
+                                mqi::private_scorer*        private_scores      = nullptr,
+                                bool                        score_local_deposit = true) {
+    std::vector<uint32_t> tracked(n_threads, 0);
+    mqi::parallel_for_chunks(
+      n_histories, chunk_size, n_threads, [&](uint32_t worker_id, size_t begin, size_t end) {
+          uint32_t done     = 0;
+          mc_private_scorer = private_scores;
+          mc_private_worker = worker_id;
+          uint64_t h        = first_history + begin;
+          uint64_t h_end    = first_history + end;
+          size_t   spot     = std::upper_bound(cdf, cdf + n_spots, h) - cdf;
+          while (h < h_end && spot < n_spots) {
+              uint64_t spot_begin = (spot == 0) ? 0 : cdf[spot - 1];
+              uint64_t item_end   = std::min<uint64_t>(h_end, cdf[spot]);
+              if (item_end > h) {
+                  mqi::spot_histories_t<R> item;
+                  item.table        = spots;
+                  item.spot_id      = spot;
+                  item.first        = h - spot_begin;
+                  item.score_offset = (score_stride > 0) ? spot * score_stride : mqi::empty_pair;
+                  item.seed         = seed;
+                  item.stream       = stream;
+                  item.rotation     = rotations[spot];
+                  item.translation  = translations[spot];
+                  threads[worker_id].rnd_generator.set_first_history(h);
+                  transport_particles_patient<R>(&threads[worker_id],
+                                                 world,
+                                                 nullptr,
+                                                 item_end - h,
+                                                 &done,
+                                                 nullptr,
+                                                 score_local_deposit,
+                                                 &item);
+                  h = item_end;
+              }
+              ++spot;
+          }
+          tracked[worker_id] += done;
+          mc_private_scorer = nullptr;
+      });
+    for (uint32_t i = 0; i < n_threads; ++i) {
+        tracked_particles[0] += tracked[i];
+    }
+}
+#endif
+
 template<typename R>
 CUDA_GLOBAL void
 transport_particles_patient_seed(mqi::thrd_t*      threads,
@@ -264,7 +594,6 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
     mqi::intersect_t<R>       its;
     mqi::dL_t<R>              Lmin;
     mqi::cnb_t                cnb;             //< child number
-    uint8_t                   nb_of_scorers;   //< scorer number
     R                         rho_mass = 1e-3;
 
     ///< count for physics process rates
@@ -277,6 +606,9 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
         } else {
             spot_ind = mqi::empty_pair;
         }
+#if !defined(__CUDACC__)
+        thread_rng->start_history(i, spot_ind);
+#endif
         mqi::track_t<R>       primary(vertices[i]);
         mqi::track_stack_t<R> stack;
         stack.push_secondary(primary);
@@ -286,7 +618,6 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
             for (c_ind = 0; c_ind < world->n_children; c_ind++) {
                 mqi::grid3d<mqi::density_t, R>& c_geo = *(world->children[c_ind]->geo);
                 track.c_node                          = world->children[c_ind];
-                nb_of_scorers                         = track.c_node->n_scorers;
                 //                track.vtx0.pos = c_geo.rotation_matrix_inv * (track.vtx0.pos - c_geo.translation_vector) + c_geo.translation_vector;   // rotate the vertex
                 //                track.vtx0.dir = c_geo.rotation_matrix_inv * (track.vtx0.dir);   // rotate the vertex
                 track.vtx0.pos =
@@ -321,11 +652,16 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
                     track.its.cell = index_checker;
                 }
 
+                if (track.c_node->rho_majorant > 0) {
+                    transport_woodcock<R>(
+                      track, stack, thread_rng, fippel, c_geo, spot_ind, score_local_deposit);
+                }
                 while (c_geo.is_valid(track.its.cell) && !track.is_stopped()) {
-                    cnb       = c_geo.ijk2cnb(track.its.cell);
+                    cnb = c_geo.ijk2cnb(track.its.cell);
+                    if (skip_empty_space<R>(track, stack, thread_rng, fippel, c_geo, cnb)) continue;
                     track.its = c_geo.intersect(track.vtx0.pos, track.vtx0.dir, track.its.cell);
                     rho_mass  = c_geo[cnb];
-                    water.rho_mass = rho_mass;
+                    water.set_density(rho_mass, track.c_node->density_table);
 #ifdef __PHYSICS_DEBUG__
                     if (!track.primary && track.dE > 0) {
                         track.stop();
@@ -348,17 +684,7 @@ transport_particles_patient_seed(mqi::thrd_t*      threads,
                                     score_local_deposit);
 #endif
                     if (track.its.dist < 0) break;
-                    for (uint8_t s = 0; s < nb_of_scorers; ++s) {
-                        if (track.c_node->scorers[s]->roi_->idx(cnb) > 0) {
-                            insert_hashtable<R>(
-                              track.c_node->scorers[s]->data_,
-                              cnb,
-                              spot_ind,
-                              track.c_node->scorers[s]->compute_hit_(track, cnb, c_geo),
-                              c_geo.get_nxyz().x * c_geo.get_nxyz().y * c_geo.get_nxyz().z,
-                              track.c_node->scorers[s]->max_capacity_);
-                        }
-                    }
+                    score_hit<R>(track, cnb, c_geo, spot_ind);
 
                     if (!track.is_stopped()) {
                         c_geo.index(track.vtx1.pos,
@@ -74,19 +74,23 @@ upload_beamsource(mqi::beamsource<R> src, mqi::beamsource<R>*& dest) {
 }
 template<typename R>
 CUDA_GLOBAL void
-add_node_geometry(mqi::node_t<R>*  node,
-                  R*               xe,
-                  mqi::ijk_t       nxe,
-                  R*               ye,
-                  mqi::ijk_t       nye,
-                  R*               ze,
-                  mqi::ijk_t       nze,
-                  mqi::density_t*  data,
-                  mqi::mat3x3<R>*  rotation_matrix_inv,
-                  mqi::mat3x3<R>*  rotation_matrix_fwd,
-                  mqi::vec3<R>*    translation_vector,
-                  uint16_t         n_children = 0,
-                  mqi::node_t<R>** children   = nullptr) {
+add_node_geometry(mqi::node_t<R>*         node,
+                  R*                      xe,
+                  mqi::ijk_t              nxe,
+                  R*                      ye,
+                  mqi::ijk_t              nye,
+                  R*                      ze,
+                  mqi::ijk_t              nze,
+                  mqi::density_t*         data,
+                  mqi::mat3x3<R>*         rotation_matrix_inv,
+                  mqi::mat3x3<R>*         rotation_matrix_fwd,
+                  mqi::vec3<R>*           translation_vector,
+                  uint16_t                n_children    = 0,
+                  mqi::node_t<R>**        children      = nullptr,
+                  R                       rho_majorant  = 0,
+                  uint8_t*                empty_space   = nullptr,
+                  R                       empty_step    = 0,
+                  mqi::density_table_t<R> density_table = mqi::density_table_t<R>()) {
 
     //std::cout << "Adding geometry node .. : Node --> " << node << ", number of children --> " << n_children << std::endl;
 
@@ -97,10 +101,15 @@ add_node_geometry(mqi::node_t<R>*  node,
     node->geo->translation_vector  = translation_vector[0];
 
     node->geo->set_data(data);
-    node->n_children   = n_children;
-    node->children     = children;
-    node->n_scorers    = 0;
-    node->scorers_data = nullptr;
+    node->n_children       = n_children;
+    node->children         = children;
+    node->rho_majorant     = rho_majorant;
+    node->empty_space      = empty_space;
+    node->empty_space_step = empty_step;
+    node->density_table    = density_table;
+    node->n_scorers        = 0;
+    node->scorers_data     = nullptr;
+    node->scorers_dense    = nullptr;
     //if (n_children >= 1) { printf("children:%d\n", n_children); }
     printf("Adding geometry node.. : Node --> %p, number of children --> %d\n", node, n_children);
 
@@ -125,12 +134,15 @@ add_node_scorers(mqi::node_t<R>*         node,
                  uint32_t*               roi_length          = nullptr,
                  uint32_t**              roi_start           = nullptr,
                  uint32_t**              roi_stride          = nullptr,
-                 uint32_t**              roi_acc_stride      = nullptr) {
+                 uint32_t**              roi_acc_stride      = nullptr,
+                 double**                scorers_dense       = nullptr,
+                 uint32_t*               dense_sizes         = nullptr) {
 
     //std::cout << "Adding scorers node .. : Node --> " << node << ", number of children --> " << n_scorers << std::endl;
 
-    node->n_scorers    = n_scorers;
-    node->scorers_data = scorers_data;
+    node->n_scorers     = n_scorers;
+    node->scorers_data  = scorers_data;
+    node->scorers_dense = scorers_dense;
     if (scorers_count) {
         node->scorers_count    = scorers_count;
         node->scorers_mean     = scorers_mean;
@@ -151,6 +163,10 @@ add_node_scorers(mqi::node_t<R>*         node,
         }
         //printf("scorer data[i] %p\n", scorers_data[i]);
         node->scorers[i]->data_ = scorers_data[i];
+        if (scorers_dense) {
+            node->scorers[i]->dense_      = scorers_dense[i];
+            node->scorers[i]->dense_size_ = dense_sizes[i];
+        }
         //        node->scorers[i]->roi_  = roi[i];
         node->scorers[i]->roi_ = new mqi::roi_t(roi_method[i],
                                                 roi_original_length[i],
@@ -179,13 +195,15 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     //std::cout << "Uploading data to node.. : Allocated node --> " << g_node << std::endl;
     ///< edge data for geometries
 
-    R*              x_edges = nullptr;
-    R*              y_edges = nullptr;
-    R*              z_edges = nullptr;
-    mqi::mat3x3<R>* rotation_matrix_inv;
-    mqi::mat3x3<R>* rotation_matrix_fwd;
-    mqi::vec3<R>*   translation_vector;
-    mqi::density_t* density = nullptr;
+    R*                      x_edges = nullptr;
+    R*                      y_edges = nullptr;
+    R*                      z_edges = nullptr;
+    mqi::mat3x3<R>*         rotation_matrix_inv;
+    mqi::mat3x3<R>*         rotation_matrix_fwd;
+    mqi::vec3<R>*           translation_vector;
+    mqi::density_t*         density       = nullptr;
+    uint8_t*                empty_space   = nullptr;
+    mqi::density_table_t<R> density_table = c_node->density_table;   ///< bins replaced below
 
     mqi::vec3<mqi::ijk_t> dim = c_node->geo->get_nxyz();
 
@@ -207,6 +225,21 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                            c_node->geo->get_data(),
                            (dim.x * dim.y * dim.z) * sizeof(mqi::density_t),
                            cudaMemcpyHostToDevice));
+    if (c_node->empty_space) {
+        gpu_err_chk(cudaMalloc(&empty_space, (dim.x * dim.y * dim.z) * sizeof(uint8_t)));
+        gpu_err_chk(cudaMemcpy(empty_space,
+                               c_node->empty_space,
+                               (dim.x * dim.y * dim.z) * sizeof(uint8_t),
+                               cudaMemcpyHostToDevice));
+    }
+    if (c_node->density_table.bins) {
+        gpu_err_chk(cudaMalloc(&density_table.bins,
+                               density_table.n_bins * sizeof(mqi::density_terms_t<R>)));
+        gpu_err_chk(cudaMemcpy(density_table.bins,
+                               c_node->density_table.bins,
+                               density_table.n_bins * sizeof(mqi::density_terms_t<R>),
+                               cudaMemcpyHostToDevice));
+    }
     gpu_err_chk(cudaMemcpy(rotation_matrix_fwd,
                            &(c_node->geo[0].rotation_matrix_fwd),
                            sizeof(mqi::mat3x3<R>),
@@ -254,6 +287,11 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     uint32_t* scorers_size   = nullptr;
     uint32_t* d_scorers_size = nullptr;
 
+    double**  h_scorers_dense = nullptr;
+    double**  d_scorers_dense = nullptr;
+    uint32_t* dense_sizes     = nullptr;
+    uint32_t* d_dense_sizes   = nullptr;
+
     mqi::fp_compute_hit<R>* fp   = nullptr;
     mqi::fp_compute_hit<R>* d_fp = nullptr;
 
@@ -261,6 +299,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     std::string* d_scorers_name = nullptr;
     if (c_node->n_scorers > 0) {
         h_scorers_data      = new mqi::key_value*[c_node->n_scorers];
+        h_scorers_dense     = new double*[c_node->n_scorers];
+        dense_sizes         = new uint32_t[c_node->n_scorers];
         scorers_types       = new mqi::scorer_t[c_node->n_scorers];
         scorers_size        = new uint32_t[c_node->n_scorers];
         scorers_name        = new std::string[c_node->n_scorers];
@@ -275,6 +315,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
         gpu_err_chk(cudaMalloc(&d_scorers_types, c_node->n_scorers * sizeof(mqi::scorer_t)));
         gpu_err_chk(cudaMalloc(&d_scorers_size, c_node->n_scorers * sizeof(uint32_t)));
         gpu_err_chk(cudaMalloc(&d_scorers_data, c_node->n_scorers * sizeof(mqi::key_value*)));
+        gpu_err_chk(cudaMalloc(&d_scorers_dense, c_node->n_scorers * sizeof(double*)));
+        gpu_err_chk(cudaMalloc(&d_dense_sizes, c_node->n_scorers * sizeof(uint32_t)));
         gpu_err_chk(cudaMalloc(&d_fp, c_node->n_scorers * sizeof(mqi::fp_compute_hit<R>)));
         gpu_err_chk(cudaMalloc(&d_roi_start, c_node->n_scorers * sizeof(uint32_t*)));
         gpu_err_chk(cudaMalloc(&d_roi_stride, c_node->n_scorers * sizeof(uint32_t*)));
@@ -308,6 +350,15 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                    c_node->scorers[i]->data_,
                                    c_node->scorers[i]->max_capacity_ * sizeof(mqi::key_value),
                                    cudaMemcpyHostToDevice));
+            dense_sizes[i]     = c_node->scorers[i]->dense_size_;
+            h_scorers_dense[i] = nullptr;
+            if (c_node->scorers[i]->dense_) {
+                gpu_err_chk(cudaMalloc(&h_scorers_dense[i], dense_sizes[i] * sizeof(double)));
+                gpu_err_chk(cudaMemcpy(h_scorers_dense[i],
+                                       c_node->scorers[i]->dense_,
+                                       dense_sizes[i] * sizeof(double),
+                                       cudaMemcpyHostToDevice));
+            }
             gpu_err_chk(
               cudaMalloc(&h_roi_start[i], c_node->scorers[i]->roi_->length_ * sizeof(uint32_t)));
             gpu_err_chk(
@@ -383,6 +434,12 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                h_scorers_data,
                                c_node->n_scorers * sizeof(mqi::key_value*),
                                cudaMemcpyHostToDevice));
+        gpu_err_chk(cudaMemcpy(d_scorers_dense,
+                               h_scorers_dense,
+                               c_node->n_scorers * sizeof(double*),
+                               cudaMemcpyHostToDevice));
+        gpu_err_chk(cudaMemcpy(
+          d_dense_sizes, dense_sizes, c_node->n_scorers * sizeof(uint32_t), cudaMemcpyHostToDevice));
 
         gpu_err_chk(cudaMemcpy(
           d_roi_start, h_roi_start, c_node->n_scorers * sizeof(uint32_t*), cudaMemcpyHostToDevice));
@@ -468,7 +525,11 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                        rotation_matrix_fwd,
                                        translation_vector,
                                        c_node->n_children,
-                                       d_children);
+                                       d_children,
+                                       c_node->rho_majorant,
+                                       empty_space,
+                                       c_node->empty_space_step,
+                                       density_table);
     cudaDeviceSynchronize();
     if (c_node->n_scorers > 0) {
         mc::add_node_scorers<R><<<1, 1>>>(g_node,
@@ -486,7 +547,9 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
                                           d_roi_length,
                                           d_roi_start,
                                           d_roi_stride,
-                                          d_roi_acc_stride);
+                                          d_roi_acc_stride,
+                                          d_scorers_dense,
+                                          d_dense_sizes);
     } else {
         mc::add_node_scorers<R><<<1, 1>>>(g_node);
     }
@@ -499,6 +562,8 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
     }
 
     delete[] h_scorers_data;
+    delete[] h_scorers_dense;
+    delete[] dense_sizes;
     delete[] h_scorers_count;
     delete[] h_scorers_mean;
     delete[] h_scorers_var;
@@ -508,6 +573,7 @@ upload_node(mqi::node_t<R>* c_node, mqi::node_t<R>*& g_node) {
 
     gpu_err_chk(cudaFree(d_scorers_types));   // it's working, but not sure it is required
     gpu_err_chk(cudaFree(d_scorers_size));    // it's working, but not sure it is required
+    gpu_err_chk(cudaFree(d_dense_sizes));
     gpu_err_chk(cudaFree(d_roi_method));
     gpu_err_chk(cudaFree(d_roi_original_length));
     gpu_err_chk(cudaFree(d_roi_length));
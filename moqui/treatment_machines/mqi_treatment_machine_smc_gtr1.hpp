@@ -139,8 +139,6 @@ public:
         // Constant energy 
         double energySpread = this->beamEnergySpreadInterp(s.e);
 
-        // Gaussian energy spread distribution
-        auto energy = new mqi::norm_1d<T>({ s.e }, { energySpread });
 
         // Caculate direction based on SAD and spot's position
         mqi::vec3<T> dir(std::atan(s.x/treatment_machine_ion<T>::SAD_[0]),
@@ -165,9 +163,11 @@ public:
         std::array<T,6> beamlet_mean = { pos.x, pos.y, pos.z, dir.x, dir.y, dir.z };
         std::array<T,6> beamlet_sigm = { spotSize , spotSize, 0, angularSpread, angularSpread, 0};
         std::array<T,2> beamlet_divergence = { divergence, divergence };
-        auto beamlet = new mqi::phsp_6d_ray<T>(beamlet_mean, beamlet_sigm, beamlet_divergence, newBeamStartingPos);
 
-        return mqi::beamlet<T>(energy, beamlet);
+        // Spots of a layer share the model of the flat spot table
+        mqi::spot_table<T>* table = this->log_spot_table();
+        uint32_t spot = table->add_spot(s.e, energySpread, beamlet_mean, beamlet_sigm, beamlet_divergence, newBeamStartingPos);
+        return mqi::beamlet<T>(table, spot);
     }
 
     mqi::rangeshifter*
@@ -258,6 +258,7 @@ public:
 
         // Creating beam source with log file information
         mqi::beamsource<T> beamsource;
+        this->spot_table_ = &beamsource.spot_table();
 
         for (int i = 0; i < logfileData.beamInfo.size(); i++)
         {
@@ -276,6 +277,8 @@ public:
                 }
             }
         }
+        printf("Creating beam source.. : %lu spots, %lu spot models\n", beamsource.spot_table().size(), beamsource.spot_table().n_models());
+        this->spot_table_ = nullptr;
         return beamsource;
     }
 };